@@ -115,8 +115,9 @@ namespace chess
 
 	[[nodiscard]] inline bitboard clear_next_bit(const bitboard bitboard) { return ::util::blsr(bitboard); }
 
+	// Get a slider's moves given any set of occupied squares, such as when pieces are removed during an exchange.
 	template <piece piece>
-	force_inline_toggle bitboard get_slider_moves(const bitboards& bitboards, const size_t start_idx)
+	force_inline_toggle bitboard get_slider_moves(const bitboard occupied, const size_t start_idx)
 	{
 		static_assert(piece == bishop || piece == rook || piece == queen);
 
@@ -131,8 +132,6 @@ namespace chess
 			rook_pext_mask = rook_pext_masks[start_idx];
 		}
 
-		const bitboard occupied = bitboards.occupied();
-
 		size_t bishop_movemask_idx;
 		size_t rook_movemask_idx;
 		if constexpr (piece == bishop || piece == queen)
@@ -144,7 +143,7 @@ namespace chess
 			rook_movemask_idx = pext(occupied, rook_pext_mask);
 		}
 
-		bitboard moves;
+		bitboard moves{};
 		if constexpr (piece == bishop || piece == queen)
 		{
 			moves |= (*bishop_move_masks)[start_idx][bishop_movemask_idx];
@@ -157,6 +156,11 @@ namespace chess
 		return moves;
 	}
 	template <piece piece>
+	force_inline_toggle bitboard get_slider_moves(const bitboards& bitboards, const size_t start_idx)
+	{
+		return get_slider_moves<piece>(bitboards.occupied(), start_idx);
+	}
+	template <piece piece>
 	force_inline_toggle bitboard get_slider_moves(const bitboards& bitboards, const bitboard square)
 	{
 		return get_slider_moves<piece>(bitboards, get_next_bit_index(square));
@@ -5,7 +5,8 @@
 
 namespace chess
 {
-	std::array<board, boards_size> boards{};
+	static board_stack main_boards{};
+	thread_local constinit board* boards = main_boards.data();
 
 	color board::load_fen(const std::string& fen)
 	{
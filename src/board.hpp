@@ -28,9 +28,17 @@ namespace chess
 
 	class board;
 
+	// Child boards only get keys during quiescence if quiescence uses the TT.
+	template <bool quiescing>
+	constexpr bool update_keys = !quiescing || config::quiescence_tt;
+
 	constexpr size_t max_n_of_moves = 256;
 	constexpr size_t boards_size = max_ply * max_n_of_moves;
-	extern std::array<board, boards_size> boards;
+	using board_stack = std::array<board, boards_size>;
+
+	// Each search thread generates child boards into its own board stack. This points to the main board stack,
+	// except on Lazy SMP helper threads, which point it at their own.
+	extern thread_local constinit board* boards;
 
 	struct move_info
 	{
@@ -48,6 +56,10 @@ namespace chess
 
 		eval_t incremental_mg_eval{};
 		eval_t incremental_eg_eval{};
+
+		// When generating a single move, the squares that it starts and ends on.
+		bitboard from_filter{};
+		bitboard to_filter{};
 	};
 
 	inline constexpr size_t first_child_index(const size_t parent_index)
@@ -309,8 +321,8 @@ namespace chess
 
 			// If a rook moves, it cannot be used to castle.
 			// Update castling rights for the moving player.
-			// During quiescence, we can't castle, so skip this.
-			if constexpr (piece == rook && !quiescing)
+			// During quiescence, we can't castle, so skip this unless the key needs the castling rights.
+			if constexpr (piece == rook && update_keys<quiescing>)
 			{
 				const rank start_rank = start_idx / 8;
 				const file start_file = start_idx % 8;
@@ -338,8 +350,8 @@ namespace chess
 
 			// If a rook is captured, it cannot be used to castle.
 			// Update castling rights for the opponent.
-			// During quiescence, we can't castle, so skip this.
-			if constexpr (move_type == move_type::capture && !quiescing)
+			// During quiescence, we can't castle, so skip this unless the key needs the castling rights.
+			if constexpr (move_type == move_type::capture && update_keys<quiescing>)
 			{
 				const rank end_rank = end_idx / 8;
 				const file end_file = end_idx % 8;
@@ -373,8 +385,8 @@ namespace chess
 			// The incremental_key has already had the leaving piece removed, and the color to move toggled.
 			// We receive it by copy so we can modify it before writing it.
 
-			// Don't update keys during quiescence.
-			if constexpr (!quiescing)
+			// Don't update keys during quiescence, unless quiescence uses the TT.
+			if constexpr (update_keys<quiescing>)
 			{
 				// Add the key for the arriving piece.
 				incremental_key ^= piece_square_key<moving_color, piece_after>(end_idx);
@@ -412,7 +424,7 @@ namespace chess
 			{
 				const size_t captured_pawn_idx = end_idx + ((moving_color == white) ? 8 : -8);
 
-				if constexpr (!quiescing)
+				if constexpr (update_keys<quiescing>)
 				{
 					// Remove key for the captured pawn.
 					incremental_key ^= piece_square_key<opp_color, pawn>(captured_pawn_idx);
@@ -429,7 +441,7 @@ namespace chess
 				constexpr size_t rook_start_index = rook_start_rank * 8 + rook_start_file;
 				constexpr size_t rook_end_index = rook_start_index + (move_type == move_type::castle_kingside ? -2 : 3);
 
-				if constexpr (!quiescing)
+				if constexpr (update_keys<quiescing>)
 				{
 					// Update keys for the moving rook.
 					incremental_key ^= piece_square_key<moving_color, rook>(rook_start_index);
@@ -444,7 +456,7 @@ namespace chess
 			}
 			else if constexpr (move_type == move_type::capture)
 			{
-				if constexpr (!quiescing)
+				if constexpr (update_keys<quiescing>)
 				{
 					// Remove the key for the captured piece.
 					incremental_key ^= piece_square_key<opp_color>(captured_piece, end_idx);
@@ -458,16 +470,19 @@ namespace chess
 				incremental_eg_eval -= eval::piece_square_eval_eg<opp_color>(captured_piece, end_idx);
 			}
 
-			if constexpr ((piece == king || piece == rook) && !quiescing)
+			if constexpr ((piece == king || piece == rook) && update_keys<quiescing>)
 			{
 				// A king or rook is moving; update our castling rights.
-				// During quiescence, we can't castle, so skip this.
+				// During quiescence, we can't castle, so skip this unless the key needs the castling rights.
 				update_key_castling_rights_for<moving_color>(incremental_key, parent_board);
 			}
 
-			if constexpr (!quiescing)
+			if constexpr (update_keys<quiescing>)
 			{
 				key = incremental_key;
+
+				// The child's bucket is probed when the child is searched. Start fetching it now.
+				if constexpr (config::tt_prefetch) tt.prefetch(key);
 			}
 
 			phase_t incremental_phase = parent_board.phase;
@@ -544,6 +559,22 @@ namespace chess
 			eval = incremental_persistent_eval + taper(incremental_phase, incremental_mg_eval, incremental_eg_eval);
 		}
 
+		// Pass the turn to the opponent without moving, for null-move pruning. The parent must not be in check.
+		void make_null_move(const board& parent_board)
+		{
+			*this = parent_board;
+			key ^= black_to_move_key();
+
+			// Remove any ep capture rights from the key.
+			if (can_capture_ep()) key ^= en_passant_key(move.get_end_file());
+
+			// Clear any ep capture rights, and the fifty-move counter, so that repetitions aren't detected across the
+			// null move.
+			board_state &= ~uint16_t((en_passant_mask << en_passant_offset) |
+			                         (fifty_move_counter_mask << fifty_move_counter_offset));
+			move = {};
+		}
+
 		tt_key get_key() const { return key; }
 		eval_t get_eval() const { return eval; }
 		template <color color_to_move>
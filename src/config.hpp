@@ -6,8 +6,92 @@ namespace chess::config
 {
 	constexpr bool verify_key_phase_eval = false;
 
-	constexpr size_t tt_size_in_mb = 1024 * 1;
+	constexpr size_t tt_default_size_in_mb = 1024 * 1;
+	constexpr size_t tt_max_size_in_mb = 1024 * 16;
 	constexpr bool tt_require_exact_depth_match = false;
+	constexpr int32_t tt_age_weight = 4; // When replacing TT entries, one search of age is worth this many plies.
+	constexpr bool tt_prefetch = true;   // Prefetch each child's TT bucket as soon as its key is known.
+	constexpr bool quiescence_tt = true; // Probe and store TT entries at depth 0 during quiescence.
+
+	constexpr size_t max_threads = 256;
+
+	constexpr bool use_huge_pages = true; // Back the TT with transparent huge pages, where supported.
+
+	// Mate distance pruning narrows each node's window to the mates that would still be shorter than one found.
+	constexpr bool mate_distance_pruning = true;
+
+	// Null-move pruning reduces the null move's search by nmp_base_reduction + depth / nmp_depth_divisor plies.
+	constexpr bool null_move_pruning = true;
+	constexpr int32_t nmp_min_depth = 3;
+	constexpr int32_t nmp_base_reduction = 2;
+	constexpr int32_t nmp_depth_divisor = 4;
+
+	// ProbCut searches captures that don't lose material at depth - probcut_depth_reduction, with a zero window at
+	// beta + probcut_margin, from probcut_min_depth on. If one fails high, the node fails high.
+	constexpr bool probcut = true;
+	constexpr int32_t probcut_min_depth = 5;
+	constexpr int32_t probcut_depth_reduction = 4;
+	constexpr int32_t probcut_margin = 200;
+
+	// Late move reductions reduce quiet moves after the first few
+	// by lmr_base + ln(depth) * ln(move number) / lmr_divisor plies.
+	constexpr bool late_move_reductions = true;
+	constexpr int32_t lmr_min_depth = 3;
+	constexpr size_t lmr_min_move_number = 3;
+	constexpr double lmr_base = 0.75;
+	constexpr double lmr_divisor = 2.25;
+
+	// Besides killers and history, quiet moves are ordered by the last quiet reply to cause a cutoff after the same
+	// previous move (countermoves), and by how they scored after the same previous one and two moves (continuation
+	// history).
+	constexpr bool countermoves = true;
+	constexpr bool continuation_history = true;
+
+	// When the TT has no move for a node, internal iterative deepening first searches the node at a reduced depth to
+	// find a move to search first. Internal iterative reduction instead just searches the node one ply shallower.
+	enum class no_tt_move_policy
+	{
+		none,
+		internal_iterative_deepening,
+		internal_iterative_reduction
+	};
+	constexpr no_tt_move_policy no_tt_move = no_tt_move_policy::internal_iterative_reduction;
+	constexpr int32_t iid_min_depth = 5; // Only at PV nodes.
+	constexpr int32_t iid_reduction = 2;
+	constexpr int32_t iir_min_depth = 4;
+
+	// Moves that give check, and singular TT moves, are extended by one ply, but by no more than max_path_extensions
+	// plies along any one path from the root.
+	constexpr int32_t max_path_extensions = 16;
+
+	// Singular extensions: a TT move from a search at least depth - se_tt_depth_margin plies deep is singular if, with
+	// it excluded, a zero-window search at half depth fails low against the TT eval minus se_margin per ply of depth.
+	constexpr bool singular_extensions = true;
+	constexpr int32_t se_min_depth = 8;
+	constexpr int32_t se_tt_depth_margin = 3;
+	constexpr int32_t se_margin = 2;
+
+	// Aspiration windows search each iteration from aspiration_min_depth on within aspiration_window of the last
+	// iteration's eval, and double the window on whichever side the search fails.
+	constexpr bool aspiration_windows = true;
+	constexpr int32_t aspiration_min_depth = 5;
+	constexpr int32_t aspiration_window = 25;
+
+	// Near the leaves, prune by the static eval, using the margins in search.hpp's pruning_margins table.
+	// Reverse futility pruning returns beta if the static eval beats it by a margin. Futility pruning skips quiet moves
+	// that don't give check if the static eval is a margin below alpha. Razoring drops into quiescence if the static
+	// eval is a margin below alpha, and returns alpha if quiescence can't beat it either.
+	constexpr bool reverse_futility_pruning = true;
+	constexpr int32_t rfp_max_depth = 6;
+	constexpr bool futility_pruning = true;
+	constexpr int32_t futility_max_depth = 3;
+	constexpr bool razoring = true;
+	constexpr int32_t razoring_max_depth = 3;
+
+	// Delta pruning stops searching captures during quiescence once even winning the captured piece for free,
+	// plus delta_margin, would not raise alpha.
+	constexpr bool delta_pruning = true;
+	constexpr int32_t delta_margin = 200;
 }
 
 #if defined __clang__
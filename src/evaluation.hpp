@@ -17,6 +17,9 @@ namespace chess::eval
 
 	constexpr std::array<phase_t, n_of_piece_types - 1> phase_weights = {0, 3, 3, 5, 10};
 
+	// Simple material values for ordering and pruning captures.
+	constexpr std::array<int32_t, n_of_piece_types> see_values = {100, 300, 300, 500, 900, 20'000};
+
 	constexpr size_t total_phase = 16 * phase_weights[pawn] +  //
 	                               4 * phase_weights[knight] + //
 	                               4 * phase_weights[bishop] + //
@@ -19,6 +19,14 @@ namespace chess
 		std::thread([this] { worker_thread(); }).detach();
 	}
 
+	game::~game()
+	{
+		// Park the worker thread and join any helpers.
+		searching = false;
+		const std::lock_guard<decltype(game_mutex)> lock(game_mutex);
+		set_threads(1);
+	}
+
 	void game::generate_child_boards_for_root()
 	{
 		size_t end_idx = 0;
@@ -29,6 +37,42 @@ namespace chess
 			end_idx = generate_child_boards<black>(0);
 
 		n_legal_moves = end_idx - first_child_index(0);
+		root_moves_restricted = false;
+		root_ordering->reset();
+	}
+
+	template <color color_to_move>
+	static void order_root_moves_by_eval(const move tt_move, const size_t begin_idx, const size_t end_idx)
+	{
+		// Before the first iteration, order the root moves by static eval, with the TT move first.
+		std::stable_sort(boards + begin_idx, boards + end_idx,
+		    [](const board& lhs, const board& rhs)
+		    { return lhs.get_eval<color_to_move>() > rhs.get_eval<color_to_move>(); });
+		swap_tt_move_to_front(tt_move, begin_idx, end_idx);
+	}
+
+	static void order_root_moves_by_nodes(const move best_move, const size_t begin_idx, const size_t end_idx)
+	{
+		// Sort the root moves and their node counts together, with the best move first.
+		const size_t first_idx = first_child_index(0);
+		std::vector<std::pair<size_t, board>> root_moves;
+		root_moves.reserve(end_idx - begin_idx);
+		for (size_t idx = begin_idx; idx < end_idx; ++idx)
+			root_moves.emplace_back(root_ordering->nodes[idx - first_idx], boards[idx]);
+
+		std::stable_sort(root_moves.begin(), root_moves.end(),
+		    [best_move](const auto& lhs, const auto& rhs)
+		    {
+			    if (lhs.second.move_is(best_move) != rhs.second.move_is(best_move)) return lhs.second.move_is(best_move);
+			    return lhs.first > rhs.first;
+		    });
+
+		for (size_t i = 0; i < root_moves.size(); ++i)
+		{
+			boards[begin_idx + i] = root_moves[i].second;
+			root_ordering->nodes[begin_idx - first_idx + i] = root_moves[i].first;
+		}
+		root_ordering->ordered = true;
 	}
 
 	void game::apply_move(const board& board)
@@ -54,9 +98,11 @@ namespace chess
 		}
 
 		generate_child_boards_for_root();
+		pv_lines.clear();
 
 		// Decrement the current depth because we're advancing down the tree by one node.
 		if (engine_depth > 0) --engine_depth;
+		engine_eval = -engine_eval;
 	}
 
 	void game::apply_move(const move move)
@@ -85,7 +131,8 @@ namespace chess
 
 		if (ponder_enabled)
 		{
-			// Ponder after playing the move.
+			// Ponder after playing the move, without the last go command's limits.
+			clear_search_limits();
 			searching = true;
 			pondering = true;
 			scheduled_turn_end = util::time_in_ms() + 1'000'000'000; // ~11 days
@@ -99,47 +146,294 @@ namespace chess
 		}
 	}
 
-	template <color color_to_move>
-	eval_t game::search(const size_t end_idx, const depth_t depth)
+	template <color color_to_move, bool main_thread>
+	eval_t game::search(const size_t begin_idx, const size_t end_idx, const depth_t depth, eval_t alpha, const eval_t beta)
 	{
 		++nodes;
 
-		eval_t alpha = -eval::mate;
-		eval_t beta = eval::mate;
+		const eval_t original_alpha = alpha;
 		eval_t eval = -eval::mate;
 
 		eval_t tt_eval{}; // ignored
 		move tt_move{};
 		tt.probe(tt_eval, tt_move, boards[0].get_key(), depth, alpha, beta, 0);
 
-		const size_t begin_idx = first_child_index(0);
+		const size_t pv_idx = begin_idx - first_child_index(0);
+		search_stack[0].made_move = boards[0].get_move();
 
-		swap_tt_move_to_front(tt_move, begin_idx, end_idx);
+		if (!root_ordering->ordered) order_root_moves_by_eval<color_to_move>(tt_move, begin_idx, end_idx);
 
 		for (size_t child_idx = begin_idx; child_idx != end_idx; ++child_idx)
 		{
-			const eval_t ab = -alpha_beta<other_color(color_to_move)>(child_idx, 1, depth - 1, -beta, -alpha);
+			const size_t nodes_before = nodes;
+			eval_t ab{};
 
-			if (!searching) return eval;
+			if (child_idx == begin_idx)
+			{
+				// Search the first move, normally the last iteration's best move, with the full window.
+				ab = -alpha_beta<other_color(color_to_move)>(child_idx, 1, depth - 1, -beta, -alpha);
+			}
+			else
+			{
+				// Do a zero-window search to show that this move is no better than the best so far.
+				ab = -alpha_beta<other_color(color_to_move)>(child_idx, 1, depth - 1, -alpha - 1, -alpha);
+
+				if (alpha < ab && ab < beta)
+				{
+					// Re-search using a full window.
+					ab = -alpha_beta<other_color(color_to_move)>(child_idx, 1, depth - 1, -beta, -alpha);
+				}
+			}
+
+			if (!*thread_searching) return eval;
+
+			root_ordering->nodes[child_idx - first_child_index(0)] = nodes - nodes_before;
 
-			if (ab > eval)
+			eval = std::max(eval, ab);
+
+			// Only a move inside the window has an exact eval. One that fails high is still our best move.
+			if (ab > alpha)
 			{
-				eval = ab;
 				update_pv(0, boards[child_idx]);
-				send_info(eval * (color_to_move == white ? 1 : -1));
 				tt_move = boards[child_idx].get_move();
+				if (main_thread && ab < beta)
+					send_info(eval * (color_to_move == white ? 1 : -1), tt_eval_type::exact, pv_idx);
 			}
+			if (eval >= beta) break;
 			alpha = std::max(alpha, eval);
-
-			swap_best_to_front<color_to_move>(child_idx + 1, end_idx);
 		}
 
-		// Store the best move in the TT.
-		tt.store(boards[0].get_key(), depth, tt_eval_type::exact, eval, 0, tt_move);
+		// Search the best move first in the next iteration, and then the moves that took the most nodes.
+		order_root_moves_by_nodes(tt_move, begin_idx, end_idx);
+
+		// Store the best move in the TT. A later MultiPV rank's eval leaves out the better moves, so only the first
+		// rank's is stored.
+		if (pv_idx > 0) return eval;
+
+		const tt_eval_type eval_type = (eval >= beta)             ? tt_eval_type::beta
+		                               : (eval <= original_alpha) ? tt_eval_type::alpha
+		                                                          : tt_eval_type::exact;
+		tt.store(boards[0].get_key(), depth, eval_type, eval, 0, tt_move);
 
 		return eval;
 	}
 
+	template <color color_to_move>
+	eval_t game::aspiration_search(const size_t pv_idx, const size_t end_idx, const depth_t depth)
+	{
+		const size_t begin_idx = first_child_index(0) + pv_idx;
+
+		// Center the window on the eval of the last iteration's line of the same rank. A rank without one is searched
+		// with a full window.
+		const bool has_previous_line = pv_idx == 0 || (pv_idx < pv_lines.size() && pv_lines[pv_idx].length > 0);
+		const eval_t previous_eval = (pv_idx == 0) ? engine_eval : (has_previous_line ? pv_lines[pv_idx].eval : eval_t{0});
+
+		if (!config::aspiration_windows || depth < config::aspiration_min_depth || !has_previous_line ||
+		    eval::found_mate(previous_eval))
+			return search<color_to_move>(begin_idx, end_idx, depth);
+
+		// The window is kept wider than an eval, so that doubling it can't overflow.
+		int32_t window = config::aspiration_window;
+		eval_t alpha = eval_t(std::max(int32_t(previous_eval) - window, int32_t(-eval::mate)));
+		eval_t beta = eval_t(std::min(int32_t(previous_eval) + window, int32_t(eval::mate)));
+
+		while (1)
+		{
+			const eval_t eval = search<color_to_move>(begin_idx, end_idx, depth, alpha, beta);
+			if (!searching) return eval;
+
+			// Widen the window on the side that failed, and search again.
+			tt_eval_type bound{};
+			if (eval <= alpha)
+			{
+				bound = tt_eval_type::alpha;
+				alpha = eval_t(std::max(int32_t(eval) - window, int32_t(-eval::mate)));
+			}
+			else if (eval >= beta)
+			{
+				bound = tt_eval_type::beta;
+				beta = eval_t(std::min(int32_t(eval) + window, int32_t(eval::mate)));
+			}
+			else
+			{
+				return eval;
+			}
+
+			send_info(eval * (color_to_move == white ? 1 : -1), bound, pv_idx);
+			window = std::min(window * 2, 2 * int32_t(eval::mate));
+		}
+	}
+
+	void game::store_pv_line(const size_t pv_idx, const eval_t eval)
+	{
+		if (pv_lines.size() <= pv_idx) pv_lines.resize(pv_idx + 1);
+		pv_lines[pv_idx] = {eval, pv_lengths[0], pv_moves[0]};
+
+		// A line can beat an earlier rank's if the search was unstable. Move it up, along with its root move.
+		const size_t first_idx = first_child_index(0);
+		for (size_t i = pv_idx; i > 0 && pv_lines[i].eval > pv_lines[i - 1].eval; --i)
+		{
+			std::swap(pv_lines[i], pv_lines[i - 1]);
+			std::swap(boards[first_idx + i], boards[first_idx + i - 1]);
+			std::swap(root_ordering->nodes[i], root_ordering->nodes[i - 1]);
+		}
+	}
+
+	void game::set_threads(const size_t n_threads)
+	{
+		// The main search thread counts as one thread.
+		const size_t n_helpers = n_threads - 1;
+
+		while (helpers.size() > n_helpers)
+		{
+			helper& helper = *helpers.back();
+			helper.exiting = true;
+			helper.busy = true;
+			helper.busy.notify_one();
+			helper.thread.join();
+			helpers.pop_back();
+		}
+
+		while (helpers.size() < n_helpers)
+		{
+			helper& helper = *helpers.emplace_back(std::make_unique<chess::helper>());
+			helper.thread = std::thread([this, &helper] { helper_thread(helper); });
+		}
+	}
+
+	void game::start_helpers(const depth_t depth)
+	{
+		helpers_searching = true;
+		helper_nodes_at_iteration = 0;
+
+		for (size_t i = 0; i < helpers.size(); ++i)
+		{
+			helper& helper = *helpers[i];
+
+			helper.boards[0] = boards[0];
+			std::copy_n(boards + first_child_index(0), n_legal_moves, helper.boards.begin() + first_child_index(0));
+			helper.n_root_moves = n_legal_moves;
+			std::copy(history, history + root_ply + 1, helper.history.begin());
+			helper.pv_lengths[0] = 0;
+			helper.color_to_move = color_to_move;
+			// Stagger the helpers so that half of them start one ply deeper than the main thread.
+			helper.start_depth = depth + (i % 2 == 0);
+			helper.completed_depth = 0;
+			helper.nodes = 0;
+
+			helper.searching = true;
+			helper.busy = true;
+			helper.busy.notify_one();
+		}
+	}
+
+	void game::stop_helpers()
+	{
+		for (auto& helper : helpers)
+			helper->searching = false;
+
+		for (auto& helper : helpers)
+			helper->busy.wait(true);
+
+		helpers_searching = false;
+	}
+
+	void game::helper_thread(helper& helper)
+	{
+		// Point this thread's search state at the helper's own.
+		boards = helper.boards.data();
+		history = helper.history.data();
+		pv_moves = helper.pv_moves.data();
+		pv_lengths = helper.pv_lengths.data();
+		ordering = &helper.ordering;
+		root_ordering = &helper.root_ordering;
+		thread_searching = &helper.searching;
+		published_nodes = &helper.nodes;
+
+		while (1)
+		{
+			// Sleep until the worker thread starts us.
+			helper.busy.wait(false);
+			if (helper.exiting) return;
+
+			nodes = 0;
+
+			const size_t end_idx = first_child_index(0) + helper.n_root_moves;
+			root_ordering->reset();
+
+			// Search deeper until the worker thread stops us.
+			for (depth_t depth = helper.start_depth; helper.searching && depth < depth_t{max_ply}; ++depth)
+			{
+				if (helper.color_to_move == white)
+					search<white, false>(first_child_index(0), end_idx, depth);
+				else
+					search<black, false>(first_child_index(0), end_idx, depth);
+
+				if (!helper.searching || pv_lengths[0] == 0) break;
+
+				helper.completed_depth = depth;
+				helper.best_move = pv_moves[0][0];
+			}
+
+			helper.nodes = nodes;
+			helper.busy = false;
+			helper.busy.notify_one();
+		}
+	}
+
+	size_t game::helper_nodes() const
+	{
+		size_t total = 0;
+		for (const auto& helper : helpers)
+			total += helper->nodes;
+		return total;
+	}
+
+	size_t game::total_nodes() const
+	{
+		// The helpers search through all iterations, so count only their nodes since this iteration started.
+		return nodes + helper_nodes() - helper_nodes_at_iteration;
+	}
+
+	move game::best_helper_move() const
+	{
+		// Return the best move of the deepest search that a helper completed beyond the main thread's depth, if any.
+		// The helpers must be stopped.
+		depth_t best_depth = engine_depth;
+		move best_move{};
+
+		for (const auto& helper : helpers)
+		{
+			if (helper->completed_depth > best_depth)
+			{
+				best_depth = helper->completed_depth;
+				best_move = helper->best_move;
+			}
+		}
+
+		return best_move;
+	}
+
+	move game::best_move() const
+	{
+		// Prefer a helper's move if it completed a deeper search. The helpers must be stopped.
+		if (const move move = best_helper_move())
+		{
+			util::log("Playing helper's move from a deeper search.");
+			return move;
+		}
+
+		// The PV can be left over from an earlier search, so check that its move is one of the root moves searched.
+		const size_t begin_idx = first_child_index(0);
+		const size_t end_idx = begin_idx + n_legal_moves;
+		if (pv_lengths[0] > 0 && std::any_of(boards + begin_idx, boards + end_idx,
+		                                        [&](const board& board) { return board.move_is(pv_moves[0][0]); }))
+			return pv_moves[0][0];
+
+		util::log("Error: stopped searching, but no PV move.");
+		return boards[begin_idx].get_move();
+	}
+
 	void game::worker_thread()
 	{
 		// Sleep until the main thread wakes us.
@@ -152,6 +446,7 @@ namespace chess
 			if (!searching)
 			{
 				// Stop searching and release the mutex until the main thread tells us to resume.
+				stop_helpers();
 				util::log("Worker stopped.");
 				lock.unlock();
 				searching.wait(false);
@@ -168,7 +463,7 @@ namespace chess
 			}
 
 			// If there is only one legal move, and it's our turn, play it.
-			if (n_legal_moves == 1 && !pondering)
+			if (n_legal_moves == 1 && !pondering && !search_single_move)
 			{
 				const move move = boards[first_child_index(0)].get_move();
 				util::log("Playing only legal move: " + move.to_string());
@@ -185,28 +480,95 @@ namespace chess
 
 			const size_t end_idx = first_child_index(0) + n_legal_moves;
 			nodes = 0;
+			iteration_node_limit = node_limit - std::min(searched_nodes, node_limit);
 			tt.hit = 0;
 			tt.miss = 0;
+			beta_cutoffs = 0;
+			first_move_beta_cutoffs = 0;
+			quiet_beta_cutoffs = 0;
+			first_quiet_beta_cutoffs = 0;
+			quiescence_nodes = 0;
+			seldepth = 0;
 
 			util::log(std::format("Engine depth {}, searching depth {}.", engine_depth, engine_depth + 1));
-			eval_t eval = 0;
-			if (color_to_move == white)
-				eval = search<white>(end_idx, engine_depth + 1);
+
+			// Start the helpers on the first iteration. They deepen on their own until we play a move or stop.
+			if (helpers_searching)
+				helper_nodes_at_iteration = helper_nodes();
 			else
-				eval = search<black>(end_idx, engine_depth + 1);
+				start_helpers(engine_depth + 1);
+
+			// Search for the best move. With MultiPV, then search the other moves for the next best, and so on.
+			const size_t n_lines = std::min(multi_pv, n_legal_moves);
+			size_t completed_lines = 0;
+
+			eval_t eval = 0;
+			for (size_t pv_idx = 0; pv_idx < n_lines; ++pv_idx)
+			{
+				if (color_to_move == white)
+					eval = aspiration_search<white>(pv_idx, end_idx, engine_depth + 1);
+				else
+					eval = aspiration_search<black>(pv_idx, end_idx, engine_depth + 1);
+
+				if (!searching) break;
+
+				if (n_lines > 1) store_pv_line(pv_idx, eval);
+				++completed_lines;
+			}
+
+			if (n_lines > 1 && completed_lines > 0)
+			{
+				// The PV tables hold the last rank searched. Restore the best line, to play its move.
+				std::copy_n(pv_lines[0].moves.begin(), pv_lines[0].length, pv_moves[0].begin());
+				pv_lengths[0] = pv_lines[0].length;
+				eval = pv_lines[0].eval;
+
+				if (completed_lines == n_lines)
+					for (size_t pv_idx = 0; pv_idx < n_lines; ++pv_idx)
+						send_info(pv_lines[pv_idx].eval * (color_to_move == white ? 1 : -1), tt_eval_type::exact,
+						    pv_idx, std::span(pv_lines[pv_idx].moves.data(), pv_lines[pv_idx].length));
+			}
 
 			engine_time = util::time_in_ms() - engine_start_time;
+			searched_nodes += nodes;
 
 			// If searching is still true, we finished another round of iterative deepening.
 			if (searching)
 			{
 				++engine_depth;
-
-				util::log(std::format("Finished depth {} in {} ms, {} nodes.", engine_depth, engine_time, nodes));
-
-				// Move immediately if we've found mate and it's our turn.
-				if (eval::found_mate(eval) && !pondering)
+				engine_eval = eval;
+
+				// The effective branching factor is the ratio of nodes searched by this iteration and the last.
+				nodes_at_depth[engine_depth] = total_nodes();
+				const size_t previous_nodes = (engine_depth > 1) ? nodes_at_depth[engine_depth - 1] : 0;
+				const double branching_factor =
+				    previous_nodes ? double(nodes_at_depth[engine_depth]) / previous_nodes : 0.0;
+
+				util::log(std::format("Finished depth {} (seldepth {}) in {} ms, {} nodes, {:.1f}% TT hit rate, "
+				                      "{:.2f} EBF, {:.1f}% first-move cutoffs, {:.1f}% first-quiet cutoffs, "
+				                      "{:.1f}% quiescence nodes, {:.2f} quiescence nodes per main search node.",
+				    engine_depth, seldepth, engine_time, nodes_at_depth[engine_depth],
+				    tt.hit * 100.0 / std::max(tt.hit + tt.miss, 1uz), branching_factor,
+				    first_move_beta_cutoffs * 100.0 / std::max(beta_cutoffs, 1uz),
+				    first_quiet_beta_cutoffs * 100.0 / std::max(quiet_beta_cutoffs, 1uz),
+				    quiescence_nodes * 100.0 / std::max(nodes, 1uz),
+				    double(quiescence_nodes) / std::max(nodes - quiescence_nodes, 1uz)));
+
+				// Log the nodes searched under each root move, in the order that the next iteration will search them.
+				std::string root_moves = "Root move nodes:";
+				for (size_t i = 0; i < n_legal_moves; ++i)
+					root_moves += std::format(
+					    " {} {}", boards[first_child_index(0) + i].get_move().to_string(), root_ordering->nodes[i]);
+				util::log(root_moves);
+
+				// Move immediately if we've found mate and it's our turn. With a mate limit, only a mate for us within the
+				// limit will do.
+				const bool mate_found =
+				    mate_limit ? eval >= eval::mate_threshold && size_t(eval::mate - eval + 1) / 2 <= mate_limit
+				               : eval::found_mate(eval);
+				if (mate_found && !pondering)
 				{
+					stop_helpers();
 					util::log("Found mate.");
 
 					move move{};
@@ -223,48 +585,49 @@ namespace chess
 					apply_move(move);
 					send_move(move);
 				}
-				else if (engine_depth >= depth_t{max_ply})
+				else if (engine_depth >= depth_limit || searched_nodes >= node_limit)
 				{
+					stop_helpers();
+
 					if (pondering)
 					{
-						util::log("Reached max ply while pondering. Stopping.");
+						util::log("Reached the depth or node limit while pondering. Stopping.");
 					}
 					else
 					{
 						const move move = pv_moves[0][0];
 						apply_move(move);
 						send_move(move);
-						util::log("Reached max ply while searching, and played best move. Stopping.");
+						util::log("Reached the depth or node limit while searching, and played best move. Stopping.");
 					}
 
 					pondering = false;
 					searching = false;
 				}
 			}
-			else if (util::time_in_ms() >= scheduled_turn_end)
+			else if (!pondering && (util::time_in_ms() >= scheduled_turn_end || searched_nodes >= node_limit))
 			{
-				// We stopped searching because we used up the planned time.
-				// Play the best move we have.
-				move move{};
-				if (pv_lengths[0] > 0)
-				{
-					move = pv_moves[0][0];
-				}
-				else
-				{
-					move = boards[first_child_index(0)].get_move();
-					util::log("Error: ran out of search time, but no PV move.");
-				}
-
+				// We stopped searching because we used up the planned time or nodes. Play the best move we have.
+				stop_helpers();
+				const move move = best_move();
 				apply_move(move);
 				send_move(move);
 			}
-			else // We were stopped by the main thread.
+			else if (!pondering)
+			{
+				// We were stopped by the main thread. UCI still expects a best move, but the game doesn't advance.
+				stop_helpers();
+				send_command("bestmove " + best_move().to_string());
+				util::log("Stopped by the main thread.");
+			}
+			else // We were stopped by the main thread, or ran out of nodes, while pondering.
 			{
 			}
 		}
 	}
 
-	template eval_t game::search<white>(const size_t, depth_t);
-	template eval_t game::search<black>(const size_t, depth_t);
+	template eval_t game::search<white, true>(const size_t, const size_t, depth_t, eval_t, const eval_t);
+	template eval_t game::search<black, true>(const size_t, const size_t, depth_t, eval_t, const eval_t);
+	template eval_t game::search<white, false>(const size_t, const size_t, depth_t, eval_t, const eval_t);
+	template eval_t game::search<black, false>(const size_t, const size_t, depth_t, eval_t, const eval_t);
 }
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <format>
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -23,18 +26,60 @@ namespace chess
 	bool load_weights(); // Forward-declare.
 #endif
 
+	// A Lazy SMP helper. Each helper searches the root position on its own board stack, repetition history, and PV
+	// tables, and shares only the transposition table with the main search thread.
+	struct helper
+	{
+		board_stack boards{};
+		std::array<tt_key, history_size> history{};
+		pv_table pv_moves{};
+		std::array<size_t, max_ply> pv_lengths{};
+		move_ordering ordering{};
+		root_move_ordering root_ordering{};
+
+		// Written by the worker thread before starting the helper, which then searches until the worker thread's
+		// search ends.
+		color color_to_move{};
+		size_t n_root_moves = 0; // The root moves are copied in too, so that helpers also honor searchmoves.
+		depth_t start_depth{};
+
+		// Read by the worker thread after stopping the helper.
+		depth_t completed_depth{};
+		move best_move{};
+
+		std::atomic_bool searching{false}; // Cleared to stop the helper's search.
+		std::atomic_bool busy{false};      // Set to start the helper, cleared by the helper when it stops.
+		std::atomic<size_t> nodes{0};
+		bool exiting = false;
+
+		std::thread thread;
+	};
+
+	// With MultiPV, the best line found for one rank, by the last search of that rank.
+	struct pv_line
+	{
+		eval_t eval{}; // For the side to move.
+		size_t length = 0;
+		std::array<move, max_ply> moves{};
+	};
+
 	class game
 	{
 	public:
 		game();
+		~game();
 		void process_uci_commands();
 
 	private:
-		void send_info(const eval_t eval);
+		// Send the current PV, or a stored line, as the line for MultiPV rank pv_idx.
+		void send_info(const eval_t eval, const tt_eval_type bound = tt_eval_type::exact, const size_t pv_idx = 0);
+		void send_info(const eval_t eval, const tt_eval_type bound, const size_t pv_idx, std::span<const move> pv);
 		void apply_moves(const std::vector<std::string>& args, size_t move_idx);
 		void process_setoption_command(std::vector<std::string>& args);
 		void process_position_command(const std::vector<std::string>& args);
 		void process_go_command(const std::vector<std::string>& args);
+		void restrict_root_moves(const std::vector<std::string>& args, size_t move_idx);
+		void clear_search_limits();
 
 		void generate_child_boards_for_root();
 
@@ -45,11 +90,29 @@ namespace chess
 
 		void send_move(const move move);
 
+		// Search the root moves from begin_idx to end_idx. With MultiPV, the moves before begin_idx are the better
+		// lines already searched by this iteration.
+		template <color color_to_move, bool main_thread = true>
+		eval_t search(const size_t begin_idx, const size_t end_idx, const depth_t depth, eval_t alpha = -eval::mate,
+		    const eval_t beta = eval::mate);
 		template <color color_to_move>
-		eval_t search(const size_t end_idx, const depth_t depth);
+		eval_t aspiration_search(const size_t pv_idx, const size_t end_idx, const depth_t depth);
+
+		// Store the line just searched for MultiPV rank pv_idx, keeping the lines sorted by eval.
+		void store_pv_line(const size_t pv_idx, const eval_t eval);
 
 		void worker_thread();
 
+		// The caller must own the game mutex.
+		void set_threads(const size_t n_threads);
+		void start_helpers(const depth_t depth);
+		void stop_helpers();
+		void helper_thread(helper& helper);
+		size_t helper_nodes() const;
+		size_t total_nodes() const;
+		move best_helper_move() const;
+		move best_move() const; // The move to play when a search is stopped early.
+
 #if tuning
 		void load_games();
 		void tune(const std::vector<std::string>& args);
@@ -59,13 +122,32 @@ namespace chess
 
 		bool pondering = false;
 		bool ponder_enabled = false;
+		std::string hash_file;
+		bool hash_file_read_only = false;
 
 		color color_to_move;
 
 		depth_t engine_depth = 0;
+		eval_t engine_eval = 0; // The eval of the last completed iteration, for the side to move.
+		std::array<size_t, max_ply + 1> nodes_at_depth{}; // Nodes searched by each iteration of the current search.
 		util::timepoint engine_start_time = 0;
 		util::timepoint engine_time = 0;
 
 		size_t n_legal_moves = 0;
+		bool root_moves_restricted = false; // Set while searchmoves leaves out some root moves.
+
+		// Limits set by the go command. The node limit counts the main search thread's nodes across iterations.
+		depth_t depth_limit = max_ply;
+		size_t node_limit = std::numeric_limits<size_t>::max();
+		size_t mate_limit = 0; // In moves. 0 for no limit.
+		size_t searched_nodes = 0;
+		bool search_single_move = false; // Set by go infinite or a limit, to search even a single legal move.
+
+		size_t multi_pv = 1;
+		std::vector<pv_line> pv_lines; // Indexed by MultiPV rank. Cleared when the root changes.
+
+		std::vector<std::unique_ptr<helper>> helpers;
+		bool helpers_searching = false;        // Set from the first iteration of a search until its move is played.
+		size_t helper_nodes_at_iteration = 0; // The helpers' nodes when the current iteration started.
 	};
 }
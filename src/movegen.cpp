@@ -35,7 +35,7 @@ namespace chess
 		++end_idx;
 
 		if constexpr (config::verify_key_phase_eval)
-			child_board.verify_key_phase_eval<!quiescing>(other_color(moving_color));
+			child_board.verify_key_phase_eval<update_keys<quiescing>>(other_color(moving_color));
 	}
 
 	template <color moving_color, gen_moves gen_moves, bool quiescing, bool perft, check_type check_type, bool in_check>
@@ -45,9 +45,11 @@ namespace chess
 		constexpr bitboard promotion_start_file = (moving_color == white) ? rank_7 : rank_2;
 
 		const bitboards& parent_bbs = parent_board.get_bitboards();
-		const bitboard pawns = parent_bbs.get<moving_color, pawn>();
+		bitboard pawns = parent_bbs.get<moving_color, pawn>();
+		// When generating a single move, generate all of the moving pawn's moves and let the caller pick one.
+		if constexpr (gen_moves == gen_moves::single) pawns &= move_info.from_filter;
 
-		if constexpr (gen_moves == gen_moves::all || gen_moves == gen_moves::captures)
+		if constexpr (gen_moves != gen_moves::noncaptures)
 		{
 			const bitboard opp_pieces = parent_bbs.get<other_color(moving_color)>();
 
@@ -63,7 +65,7 @@ namespace chess
 				capture_to_lower_file_promotion = clear_next_bit(capture_to_lower_file_promotion);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -89,7 +91,7 @@ namespace chess
 				capture_to_lower_file = clear_next_bit(capture_to_lower_file);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -111,7 +113,7 @@ namespace chess
 				capture_to_higher_file_promotion = clear_next_bit(capture_to_higher_file_promotion);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -137,7 +139,7 @@ namespace chess
 				capture_to_higher_file = clear_next_bit(capture_to_higher_file);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -162,7 +164,7 @@ namespace chess
 					ep_capturers = clear_next_bit(ep_capturers);
 
 					tt_key incremental_key{};
-					if constexpr (!quiescing && !perft)
+					if constexpr (update_keys<quiescing> && !perft)
 					{
 						incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 					}
@@ -174,7 +176,7 @@ namespace chess
 			}
 		}
 
-		if constexpr (gen_moves == gen_moves::all || gen_moves == gen_moves::noncaptures)
+		if constexpr (gen_moves != gen_moves::captures)
 		{
 			const bitboard empty_squares = parent_bbs.empty();
 
@@ -189,7 +191,7 @@ namespace chess
 				noncapture_promotions = clear_next_bit(noncapture_promotions);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -218,7 +220,7 @@ namespace chess
 				move_two_squares = clear_next_bit(move_two_squares);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -235,7 +237,7 @@ namespace chess
 				move_one_square = clear_next_bit(move_one_square);
 
 				tt_key incremental_key{};
-				if constexpr (!quiescing && !perft)
+				if constexpr (update_keys<quiescing> && !perft)
 				{
 					incremental_key = key ^ piece_square_key<moving_color, pawn>(start_idx);
 				}
@@ -299,13 +301,18 @@ namespace chess
 
 		const bitboards& parent_bbs = parent_board.get_bitboards();
 		bitboard pieces = parent_bbs.get<moving_color, piece>();
+		if constexpr (gen_moves == gen_moves::single)
+		{
+			pieces &= move_info.from_filter;
+			if (!pieces) return;
+		}
 
 		while (piece == king || pieces)
 		{
 			const size_t piece_idx = (piece != king) ? get_next_bit_index(pieces) : king_idx;
 
 			tt_key incremental_key{};
-			if constexpr (!quiescing && !perft)
+			if constexpr (update_keys<quiescing> && !perft)
 			{
 				// XOR the key for the leaving piece once for all of its moves.
 				incremental_key = key ^ piece_square_key<moving_color, piece>(piece_idx);
@@ -327,12 +334,13 @@ namespace chess
 				moves = king_attack_masks[piece_idx];
 			else
 				moves = get_slider_moves<piece>(parent_bbs, piece_idx);
+			if constexpr (gen_moves == gen_moves::single) moves &= move_info.to_filter;
 
 			const bitboard from = (piece != king) ? get_next_bit(pieces) : pieces;
 			pieces = clear_next_bit(pieces);
 
 			bitboard captures = moves & parent_bbs.get<other_color(moving_color)>();
-			while (captures && (gen_moves == gen_moves::captures || gen_moves == gen_moves::all))
+			while (captures && gen_moves != gen_moves::noncaptures)
 			{
 				const bitboard to = get_next_bit(captures);
 				captures = clear_next_bit(captures);
@@ -341,7 +349,7 @@ namespace chess
 			}
 
 			bitboard noncaptures = moves & parent_bbs.empty();
-			while (noncaptures && (gen_moves == gen_moves::noncaptures || gen_moves == gen_moves::all))
+			while (noncaptures && gen_moves != gen_moves::captures)
 			{
 				const bitboard to = get_next_bit(noncaptures);
 				noncaptures = clear_next_bit(noncaptures);
@@ -370,19 +378,22 @@ namespace chess
 		find_moves_for<moving_color, gen_moves, quiescing, perft, check_type::all, false, king>(
 		    end_idx, parent_board, blockers, king_idx, key, move_info);
 
-		if constexpr (!in_check && !quiescing && (gen_moves == gen_moves::all || gen_moves == gen_moves::noncaptures))
+		if constexpr (!in_check && !quiescing && gen_moves != gen_moves::captures)
 		{
-			find_castle_moves<moving_color, perft>(end_idx, parent_board, key, move_info);
+			const bitboard king = parent_board.get_bitboards().get<moving_color, chess::king>();
+			if (gen_moves != gen_moves::single || (move_info.from_filter & king))
+				find_castle_moves<moving_color, perft>(end_idx, parent_board, key, move_info);
 		}
 	}
 
 	template <color moving_color, gen_moves gen_moves, bool quiescing, bool perft>
-	size_t generate_child_boards(const size_t parent_idx)
+	force_inline_toggle static size_t find_child_boards(
+	    const size_t parent_idx, size_t end_idx, const bitboard from_filter = {}, const bitboard to_filter = {})
 	{
 		const board& parent_board = boards[parent_idx];
 
 		tt_key key{};
-		if constexpr (!quiescing && !perft)
+		if constexpr (update_keys<quiescing> && !perft)
 		{
 			key = parent_board.get_key() ^ black_to_move_key();
 
@@ -416,13 +427,14 @@ namespace chess
 		move_info.bishops_and_queens = bishops | queens;
 		const bitboard rooks = parent_bbs.get<moving_color, rook>();
 		move_info.rooks_and_queens = rooks | queens;
+		move_info.from_filter = from_filter;
+		move_info.to_filter = to_filter;
 
 		// Filter which types of checks we need to look for during move generation,
 		// based on which piece (if any) is attacking the king.
 
 		const piece last_moved_piece = parent_board.get_moved_piece();
 		const size_t king_idx = get_next_bit_index(parent_bbs.get<moving_color, king>());
-		size_t end_idx = first_child_index(parent_idx);
 
 		if (last_moved_piece == pawn && square_is_attacked_by_pawn<opp_color>(parent_bbs, king_idx))
 		{
@@ -452,6 +464,31 @@ namespace chess
 		return end_idx;
 	}
 
+	template <color moving_color, gen_moves gen_moves, bool quiescing, bool perft>
+	size_t generate_child_boards(const size_t parent_idx)
+	{
+		return find_child_boards<moving_color, gen_moves, quiescing, perft>(parent_idx, first_child_index(parent_idx));
+	}
+
+	template <color moving_color>
+	size_t generate_child_board(const size_t parent_idx, const size_t end_idx, const move move)
+	{
+		const size_t found_end_idx = find_child_boards<moving_color, gen_moves::single, false, false>(
+		    parent_idx, end_idx, 1ull << move.get_start_index(), 1ull << move.get_end_index());
+
+		// A pawn or king may have generated other moves too. Keep only this one.
+		for (size_t idx = end_idx; idx < found_end_idx; ++idx)
+		{
+			if (boards[idx].move_is(move))
+			{
+				if (idx != end_idx) boards[end_idx] = boards[idx];
+				return end_idx + 1;
+			}
+		}
+
+		return end_idx;
+	}
+
 	template size_t generate_child_boards<white, gen_moves::all>(const size_t);
 	template size_t generate_child_boards<white, gen_moves::captures>(const size_t);
 	template size_t generate_child_boards<white, gen_moves::noncaptures>(const size_t);
@@ -461,12 +498,13 @@ namespace chess
 	template size_t generate_child_boards<black, gen_moves::noncaptures>(const size_t);
 
 	// For quiescence search:
-	template size_t generate_child_boards<white, gen_moves::all, true>(const size_t);
 	template size_t generate_child_boards<white, gen_moves::captures, true>(const size_t);
-	template size_t generate_child_boards<black, gen_moves::all, true>(const size_t);
 	template size_t generate_child_boards<black, gen_moves::captures, true>(const size_t);
 
 	// For perft:
 	template size_t generate_child_boards<white, gen_moves::all, false, true>(const size_t);
 	template size_t generate_child_boards<black, gen_moves::all, false, true>(const size_t);
+
+	template size_t generate_child_board<white>(const size_t, const size_t, const move);
+	template size_t generate_child_board<black>(const size_t, const size_t, const move);
 }
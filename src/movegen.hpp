@@ -9,9 +9,14 @@ namespace chess
 	{
 		all,
 		captures,
-		noncaptures
+		noncaptures,
+		single // Only the moves between the squares in move_info's filters.
 	};
 
 	template <color color_to_move, gen_moves gen_moves = gen_moves::all, bool quiescing = false, bool perft = false>
 	size_t generate_child_boards(const size_t parent_idx);
+
+	// Make the child board for one move at end_idx, if the move is legal. Return the new end index.
+	template <color color_to_move>
+	size_t generate_child_board(const size_t parent_idx, const size_t end_idx, const move move);
 }
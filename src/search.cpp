@@ -1,18 +1,53 @@
+#include <cmath>
+
 #include "search.hpp"
 #include "util/util.hpp"
 
 namespace chess
 {
 	size_t root_ply{0};
-	std::array<tt_key, max_ply * 4> history{};
 	std::atomic_bool searching{false};
 	util::timepoint scheduled_turn_end{0};
-	size_t nodes{0};
+	thread_local constinit size_t iteration_node_limit = std::numeric_limits<size_t>::max();
 
 	transposition_table tt;
 
-	std::array<size_t, max_ply> pv_lengths;
-	std::array<std::array<move, max_ply>, max_ply> pv_moves;
+	static std::array<tt_key, history_size> main_history{};
+	static pv_table main_pv_moves{};
+	static std::array<size_t, max_ply> main_pv_lengths{};
+
+	thread_local constinit tt_key* history = main_history.data();
+	thread_local constinit std::array<move, max_ply>* pv_moves = main_pv_moves.data();
+	thread_local constinit size_t* pv_lengths = main_pv_lengths.data();
+	thread_local constinit size_t nodes{0};
+	thread_local constinit size_t quiescence_nodes{0};
+	thread_local constinit size_t seldepth{0};
+	thread_local constinit std::array<search_stack_entry, max_ply + 1> search_stack{};
+
+	static move_ordering main_ordering{};
+	thread_local constinit move_ordering* ordering = &main_ordering;
+	static root_move_ordering main_root_ordering{};
+	thread_local constinit root_move_ordering* root_ordering = &main_root_ordering;
+	thread_local constinit size_t beta_cutoffs{0};
+	thread_local constinit size_t first_move_beta_cutoffs{0};
+	thread_local constinit size_t quiet_beta_cutoffs{0};
+	thread_local constinit size_t first_quiet_beta_cutoffs{0};
+
+	thread_local constinit std::atomic_bool* thread_searching = &searching;
+	thread_local constinit std::atomic<size_t>* published_nodes = nullptr;
+
+	// Late move reductions, indexed by depth and move number, both capped at 63.
+	static const auto lmr_reductions = []()
+	{
+		std::array<std::array<uint8_t, 64>, 64> reductions{};
+
+		for (size_t depth = 1; depth < 64; ++depth)
+			for (size_t move_number = 1; move_number < 64; ++move_number)
+				reductions[depth][move_number] = uint8_t(
+				    config::lmr_base + std::log(double(depth)) * std::log(double(move_number)) / config::lmr_divisor);
+
+		return reductions;
+	}();
 
 	void update_pv(const size_t ply, const board& board)
 	{
@@ -44,17 +79,74 @@ namespace chess
 		return false;
 	}
 
+	// A quiet move is neither a capture nor a promotion.
+	static bool is_quiet(const board& parent_board, const board& child_board)
+	{
+		return ::util::popcount(child_board.get_bitboards().occupied()) ==
+		           ::util::popcount(parent_board.get_bitboards().occupied()) &&
+		       !child_board.get_move().is_promotion();
+	}
+
+	// Moves are searched in stages, so that the child boards for later stages are only made if earlier stages don't
+	// cause a cutoff.
+	enum class stage
+	{
+		tt_move,
+		captures,
+		killers,
+		quiets,
+		done
+	};
+
+	// The most material that a capture can win: the captured piece, plus the promoted piece for a promotion.
+	static int32_t max_capture_gain(const bitboards& bitboards, const move move)
+	{
+		if (move.is_promotion()) return captured_value(bitboards, move) + eval::see_values[move.get_moved_piece()];
+		return captured_value(bitboards, move);
+	}
+
+	// Remove the child board for a move that an earlier stage already searched. Return the new end index.
+	static size_t remove_searched_move(const move move, const size_t begin_idx, const size_t end_idx)
+	{
+		if (!move) return end_idx;
+
+		for (size_t idx = begin_idx; idx < end_idx; ++idx)
+		{
+			if (boards[idx].move_is(move))
+			{
+				boards[idx] = boards[end_idx - 1];
+				return end_idx - 1;
+			}
+		}
+
+		return end_idx;
+	}
+
+	// Futility pruning: drop the quiet moves in a batch that don't give check or promote. Return the new end index.
+	static size_t remove_futile_moves(const size_t begin_idx, size_t end_idx)
+	{
+		for (size_t idx = begin_idx; idx < end_idx;)
+		{
+			if (boards[idx].in_check() || boards[idx].get_move().is_promotion())
+				++idx;
+			else
+				boards[idx] = boards[--end_idx];
+		}
+
+		return end_idx;
+	}
+
 	inline_toggle static bool detect_draws(const board& board, const size_t ply)
 	{
 		// Return true if:
 		// - This position has been seen before, or
 		// - 100 moves have passed since the last capture or pawn advance.
 		const size_t fifty_move_counter = board.get_fifty_move_counter();
-		auto history_end = history.data() + root_ply + ply;
+		auto history_end = history + root_ply + ply;
 		const tt_key key = board.get_key();
 		if (fifty_move_counter >= 4)
 		{
-			const auto earliest_possible_repetition = std::max(history_end - fifty_move_counter, history.data());
+			const auto earliest_possible_repetition = std::max(history_end - fifty_move_counter, history);
 			for (auto history_ptr = history_end - 4; history_ptr >= earliest_possible_repetition; history_ptr -= 2)
 			{
 				if (*history_ptr == key)
@@ -73,76 +165,361 @@ namespace chess
 		return false;
 	}
 
+	// A TT move is singular if its TT entry shows that it's at least as good as the TT eval, and a shallower search of
+	// the other moves shows that none of them come close.
+	template <color color_to_move>
+	static bool is_singular(const size_t idx, const size_t ply, const depth_t depth, const move tt_move)
+	{
+		tt_data entry;
+		if (!tt.peek(entry, boards[idx].get_key(), ply)) return false;
+
+		if (entry.eval_depth < depth - config::se_tt_depth_margin || entry.eval_type == tt_eval_type::alpha ||
+		    eval::found_mate(entry.eval))
+			return false;
+
+		const eval_t singular_beta = entry.eval - config::se_margin * depth;
+
+		search_stack[ply].excluded_move = tt_move;
+		const eval_t eval = alpha_beta<color_to_move>(idx, ply, (depth - 1) / 2, singular_beta - 1, singular_beta);
+		search_stack[ply].excluded_move = {};
+
+		// Forget any PV found by the search of the other moves.
+		pv_lengths[ply] = ply;
+
+		return eval < singular_beta;
+	}
+
 	template <color color_to_move, bool quiescing>
-	eval_t alpha_beta(const size_t idx, const size_t ply, const depth_t depth, eval_t alpha, eval_t beta)
+	eval_t alpha_beta(const size_t idx, const size_t ply, depth_t depth, eval_t alpha, eval_t beta)
 	{
-		// Stop searching if we're out of time.
-		if (++nodes % 1024 == 0 && util::time_in_ms() >= scheduled_turn_end)
+		if (++nodes % 1024 == 0)
 		{
-			searching = false;
-			return 0;
+			if (published_nodes) *published_nodes = nodes;
+
+			// Stop searching if we're out of time or nodes.
+			if (nodes >= iteration_node_limit || util::time_in_ms() >= scheduled_turn_end)
+			{
+				*thread_searching = false;
+				return 0;
+			}
 		}
 
-		if constexpr (!quiescing) pv_lengths[ply] = ply;
+		if constexpr (quiescing) ++quiescence_nodes;
+
+		if constexpr (!quiescing)
+		{
+			pv_lengths[ply] = ply;
+			seldepth = std::max(seldepth, ply);
+		}
 
 		const board& board = boards[idx];
 
+		// While checking whether the TT move is singular, this node is searched without it. That search has its own
+		// result, so it doesn't use this node's TT entry, or prune.
+		const move excluded_move = quiescing ? move{} : search_stack[ply].excluded_move;
+
+		// Quiet moves are ordered by how well they answered the same previous moves elsewhere in the tree.
+		previous_moves previous{};
+		if constexpr (!quiescing)
+		{
+			search_stack[ply].made_move = board.get_move();
+			// The search normally starts from the root's children, at ply 1, but tuning searches the root itself.
+			previous = {board.get_move(), (ply > 0) ? search_stack[ply - 1].made_move : move{}};
+		}
+
 		if (!quiescing && detect_draws(board, ply)) return 0;
 
+		// Mate distance pruning: nothing found from here can beat being mated right now, or giving mate with the next
+		// move. If a shorter mate is already known, the window collapses, and nothing here can matter.
+		if constexpr (!quiescing && config::mate_distance_pruning)
+		{
+			alpha = std::max(alpha, eval_t(-eval::mate + ply));
+			beta = std::min(beta, eval_t(eval::mate - ply - 1));
+			if (alpha >= beta) return alpha;
+		}
+
 		// Enter quiescence at nominal leaf nodes.
 		if (!quiescing && depth == 0) return alpha_beta<color_to_move, true>(idx, ply, 0, alpha, beta);
 
+		const tt_key key = board.get_key();
+
+		// If we already have an evaluation that is valid for this node at this depth, return it. During quiescence,
+		// the depth is 0, so any entry for this position will do.
+		move tt_move{};
+		eval_t tt_eval{};
+		if ((!quiescing || config::quiescence_tt) && !excluded_move &&
+		    tt.probe(tt_eval, tt_move, key, depth, alpha, beta, ply))
+			return tt_eval;
+
+		eval_t stand_pat{};
 		if constexpr (quiescing)
 		{
-			const eval_t stand_pat = board.get_eval<color_to_move>();
+			stand_pat = board.get_eval<color_to_move>();
 
 			if (stand_pat >= beta) return beta;
 			alpha = std::max(alpha, stand_pat);
 		}
 
-		const tt_key key = board.get_key();
-
-		// If we already have an evaluation that is valid for this node at this depth, return it.
-		move tt_move{};
-		eval_t tt_eval{};
-		if (!quiescing && tt.probe(tt_eval, tt_move, key, depth, alpha, beta, ply)) return tt_eval;
-
 		// If we have reached our max depth (ie, if we could not generate child boards for this position)
 		// return this node's static evaluation.
-		if (idx >= boards.size() - max_n_of_moves) return board.get_eval<color_to_move>();
+		if (idx >= boards_size - max_n_of_moves) return board.get_eval<color_to_move>();
 
-		const size_t begin_idx = first_child_index(idx);
-		size_t end_idx{};
-		gen_moves generated_moves{};
+		// Near the leaves, prune non-PV nodes using the static eval. Don't prune when in check, or when a bound is a
+		// mate score.
+		bool futile = false;
+		if constexpr (!quiescing)
+		{
+			const bool pv_node = beta - alpha > 1;
+			if (!pv_node && !excluded_move && !board.in_check() && !eval::found_mate(alpha) &&
+			    !eval::found_mate(beta))
+			{
+				const eval_t static_eval = board.get_eval<color_to_move>();
+
+				// Reverse futility pruning: assume that some move keeps the static eval above beta.
+				if (config::reverse_futility_pruning && depth <= config::rfp_max_depth &&
+				    static_eval - pruning_margin(rfp_margins_start, depth) >= beta)
+					return beta;
+
+				// Razoring: if the static eval is far below alpha, check whether any capture can get back above it.
+				if (config::razoring && depth <= config::razoring_max_depth &&
+				    static_eval + pruning_margin(razoring_margins_start, depth) <= alpha)
+				{
+					const eval_t q_eval = alpha_beta<color_to_move, true>(idx, ply, 0, alpha, alpha + 1);
+					if (!*thread_searching) return 0;
+					if (q_eval <= alpha) return alpha;
+				}
+
+				// Futility pruning: quiet moves are unlikely to make up the difference. See the killers and quiets
+				// stages below.
+				futile = config::futility_pruning && depth <= config::futility_max_depth &&
+				         static_eval + pruning_margin(futility_margins_start, depth) <= alpha;
+			}
+		}
+
+		// Null-move pruning: if passing the turn still fails high at a reduced depth, assume that some real move would
+		// too. This is unsound in zugzwang, so only try it when we have pieces other than pawns.
+		if constexpr (!quiescing && config::null_move_pruning)
+		{
+			const bool pv_node = beta - alpha > 1;
+			const bitboards& bitboards = board.get_bitboards();
+			const bitboard non_pawn_material = bitboards.get<color_to_move>() & ~(bitboards.pawns | bitboards.kings);
+
+			// Only prune non-PV nodes, where we expect to fail high anyway. Don't make two null moves in a row.
+			if (!pv_node && depth >= config::nmp_min_depth && !excluded_move && !board.in_check() &&
+			    !board.move_is(move{}) && non_pawn_material && board.get_eval<color_to_move>() >= beta)
+			{
+				const size_t null_idx = first_child_index(idx);
+				boards[null_idx].make_null_move(board);
+				search_stack[ply + 1].extensions = search_stack[ply].extensions;
+
+				const int32_t reduction = config::nmp_base_reduction + int32_t(depth) / config::nmp_depth_divisor;
+				const depth_t null_depth = std::max(int32_t(depth) - 1 - reduction, 0);
+				const eval_t null_eval =
+				    -alpha_beta<other_color(color_to_move)>(null_idx, ply + 1, null_depth, -beta, -beta + 1);
+
+				if (!*thread_searching) return 0;
+
+				if (null_eval >= beta) return beta;
+			}
+		}
+
+		// ProbCut: if a capture that doesn't lose material beats beta by a wide margin at a much reduced depth, assume
+		// that it would beat beta at full depth too.
+		if constexpr (!quiescing && config::probcut)
+		{
+			const bool pv_node = beta - alpha > 1;
+			const int32_t probcut_beta = int32_t(beta) + config::probcut_margin;
 
-		if (quiescing || !tt_move || is_capture(idx, tt_move))
+			if (!pv_node && depth >= config::probcut_min_depth && !excluded_move && !board.in_check() &&
+			    !eval::found_mate(beta) && probcut_beta < eval::mate_threshold)
+			{
+				const size_t begin_idx = first_child_index(idx);
+				const size_t end_idx = generate_child_boards<color_to_move, gen_moves::captures>(idx);
+				size_t bad_captures_idx = end_idx;
+
+				const bitboards& bitboards = board.get_bitboards();
+				const int32_t static_eval = board.get_eval<color_to_move>();
+				const depth_t probcut_depth = depth - config::probcut_depth_reduction;
+
+				for (size_t child_idx = begin_idx; child_idx < end_idx; ++child_idx)
+				{
+					// Captures that lose material are moved behind bad_captures_idx, and searched last, so stop there.
+					swap_best_capture_to_front<color_to_move>(idx, child_idx, bad_captures_idx, end_idx);
+					if (child_idx >= bad_captures_idx) break;
+
+					// Skip captures that don't win enough material to reach probcut_beta from the static eval.
+					const move move = boards[child_idx].get_move();
+					const int32_t gain = move.is_promotion() ? max_capture_gain(bitboards, move)
+					                                         : static_exchange_eval<color_to_move>(bitboards, move);
+					if (static_eval + gain < probcut_beta) continue;
+
+					// Check with quiescence first, which is much cheaper, and usually enough to rule the capture out.
+					eval_t probcut_eval = -alpha_beta<other_color(color_to_move), true>(
+					    child_idx, ply + 1, 0, eval_t(-probcut_beta), eval_t(-probcut_beta + 1));
+
+					if (probcut_eval >= probcut_beta)
+					{
+						search_stack[ply + 1].extensions = search_stack[ply].extensions;
+						probcut_eval = -alpha_beta<other_color(color_to_move)>(
+						    child_idx, ply + 1, probcut_depth, eval_t(-probcut_beta), eval_t(-probcut_beta + 1));
+					}
+
+					if (!*thread_searching) return 0;
+
+					if (probcut_eval >= probcut_beta)
+					{
+						tt.store(key, probcut_depth + 1, tt_eval_type::beta, beta, ply, move);
+						return beta;
+					}
+				}
+			}
+		}
+
+		if constexpr (!quiescing && config::no_tt_move == config::no_tt_move_policy::internal_iterative_deepening)
 		{
-			end_idx = generate_child_boards<color_to_move, gen_moves::captures, quiescing>(idx);
-			generated_moves = gen_moves::captures;
+			// Internal iterative deepening: search this node at a reduced depth, and search its best move first.
+			const bool pv_node = beta - alpha > 1;
+			if (!tt_move && !excluded_move && pv_node && depth >= config::iid_min_depth)
+			{
+				alpha_beta<color_to_move>(idx, ply, depth - config::iid_reduction, alpha, beta);
+				if (!*thread_searching) return 0;
+
+				pv_lengths[ply] = ply;
+				tt.probe(tt_eval, tt_move, key, depth, alpha, beta, ply); // Only for the move.
+			}
 		}
-		else // We have a non-capture tt_move.
+		else if constexpr (!quiescing &&
+		                   config::no_tt_move == config::no_tt_move_policy::internal_iterative_reduction)
 		{
-			end_idx = generate_child_boards<color_to_move, gen_moves::all, quiescing>(idx);
-			generated_moves = gen_moves::all;
+			// Internal iterative reduction: without a move from an earlier search, this node's move ordering is poor,
+			// and it was likely not important enough to store. Spend less on it.
+			if (!tt_move && !excluded_move && depth >= config::iir_min_depth) --depth;
 		}
 
-		if (!quiescing && tt_move)
-			swap_tt_move_to_front(tt_move, begin_idx, end_idx);
-		else
-			swap_best_to_front<color_to_move>(begin_idx, end_idx);
+		const size_t begin_idx = first_child_index(idx);
+		size_t end_idx = begin_idx;
+
+		// Captures that lose material are moved to the end of the capture batch, starting here.
+		size_t bad_captures_idx = end_idx;
 
 		bool found_moves = false;
-		eval_t eval = -eval::mate;
+
+		// During quiescence, standing pat is a lower bound on this node's eval, so start from it. Otherwise, a node
+		// where no capture reaches the static eval would store an upper bound below it.
+		eval_t eval = (quiescing && !board.in_check()) ? stand_pat : eval_t{-eval::mate};
 		tt_eval_type node_eval_type = tt_eval_type::alpha;
 
 		bool found_pv = false;
+		size_t move_number = 0; // Counts across all stages.
+
+		// Moves already searched by an earlier stage, to remove from later batches. An excluded move is treated as
+		// already searched.
+		move searched_tt_move = excluded_move;
+		std::array<move, 2> searched_killers{};
+
+		bool singular = false;
 
-		while (1)
+		stage next_stage = quiescing ? stage::captures : stage::tt_move;
+
+		while (next_stage != stage::done)
 		{
+			// Make the child boards for this stage's batch of moves.
+			const stage batch = next_stage;
+			switch (batch)
+			{
+			case stage::tt_move:
+				// Check whether the TT move is singular before making its board, since the search of the other moves
+				// makes its boards in the same place.
+				if constexpr (config::singular_extensions)
+					if (tt_move && depth >= config::se_min_depth && !excluded_move)
+					{
+						singular = is_singular<color_to_move>(idx, ply, depth, tt_move);
+						if (!*thread_searching) return 0;
+					}
+
+				if (tt_move) end_idx = generate_child_board<color_to_move>(idx, begin_idx, tt_move);
+				if (end_idx != begin_idx) searched_tt_move = tt_move;
+				next_stage = stage::captures;
+				break;
+
+			case stage::captures:
+				end_idx = generate_child_boards<color_to_move, gen_moves::captures, quiescing>(idx);
+				end_idx = remove_searched_move(searched_tt_move, begin_idx, end_idx);
+				bad_captures_idx = end_idx;
+				if (begin_idx != end_idx)
+					swap_best_capture_to_front<color_to_move>(idx, begin_idx, bad_captures_idx, end_idx);
+
+				// During quiescence, only search noncaptures if we're in check.
+				next_stage = !quiescing ? stage::killers : board.in_check() ? stage::quiets : stage::done;
+				break;
+
+			case stage::killers:
+				// A killer comes from a sibling node, so it may be illegal or a capture here.
+				end_idx = begin_idx;
+				for (size_t i = 0; i < ordering->killers[ply].size(); ++i)
+				{
+					const move killer = ordering->killers[ply][i];
+					if (!killer || killer == searched_tt_move || is_capture(idx, killer)) continue;
+
+					const size_t killer_idx = end_idx;
+					end_idx = generate_child_board<color_to_move>(idx, end_idx, killer);
+					if (end_idx != killer_idx) searched_killers[i] = killer;
+				}
+				if (futile && begin_idx != end_idx)
+				{
+					found_moves = true;
+					end_idx = remove_futile_moves(begin_idx, end_idx);
+					eval = std::max(eval, alpha);
+				}
+				next_stage = stage::quiets;
+				break;
+
+			case stage::quiets:
+				end_idx = generate_child_boards<color_to_move, gen_moves::noncaptures>(idx);
+				end_idx = remove_searched_move(searched_tt_move, begin_idx, end_idx);
+				for (const move killer : searched_killers)
+					end_idx = remove_searched_move(killer, begin_idx, end_idx);
+				if (futile && begin_idx != end_idx)
+				{
+					found_moves = true;
+					end_idx = remove_futile_moves(begin_idx, end_idx);
+					eval = std::max(eval, alpha);
+				}
+
+				// Order the quiet moves by history.
+				if (begin_idx != end_idx) swap_best_quiet_to_front<color_to_move>(previous, begin_idx, end_idx);
+				next_stage = stage::done;
+				break;
+
+			default: break;
+			}
+
 			if (begin_idx != end_idx) found_moves = true;
 
 			for (size_t child_idx = begin_idx; child_idx < end_idx; ++child_idx)
 			{
+				// During quiescence, skip captures that lose material, unless we're in check. Assume that they
+				// wouldn't raise alpha.
+				if constexpr (quiescing)
+				{
+					if (batch == stage::captures && child_idx >= bad_captures_idx && !board.in_check())
+					{
+						eval = std::max(eval, alpha);
+						break;
+					}
+
+					// Delta pruning: captures are ordered by what they win, so once winning this capture's piece for
+					// free can't raise alpha, neither can the rest.
+					if (config::delta_pruning && batch == stage::captures && !board.in_check() &&
+					    stand_pat + max_capture_gain(board.get_bitboards(), boards[child_idx].get_move()) +
+					            config::delta_margin <=
+					        alpha)
+					{
+						eval = std::max(eval, alpha);
+						break;
+					}
+				}
+
 				size_t next_depth{};
 				if constexpr (quiescing)
 				{
@@ -153,13 +530,43 @@ namespace chess
 				{
 					next_depth = depth - 1;
 
-					// Extend the search by one ply for moves that give check.
-					next_depth += boards[child_idx].in_check();
+					// Extend the search by one ply for moves that give check, and for a singular TT move, until this
+					// path runs out of extensions.
+					const bool extend = (boards[child_idx].in_check() || (batch == stage::tt_move && singular)) &&
+					                    search_stack[ply].extensions < config::max_path_extensions;
+					next_depth += extend;
+					search_stack[ply + 1].extensions = search_stack[ply].extensions + extend;
 				}
 
 				eval_t ab{};
 
-				if (found_pv)
+				// Late move reductions: search quiet moves late in the ordering at a reduced depth with a zero window.
+				// If one beats alpha, search it again below as usual.
+				bool reduced_search_failed_low = false;
+				if constexpr (!quiescing && config::late_move_reductions)
+				{
+					if (depth >= config::lmr_min_depth && move_number >= config::lmr_min_move_number &&
+					    is_quiet(board, boards[child_idx]) && !board.in_check() && !boards[child_idx].in_check())
+					{
+						const size_t reduction =
+						    std::min(size_t(lmr_reductions[std::min(size_t(depth), 63uz)][std::min(move_number, 63uz)]),
+						        next_depth - 1);
+
+						if (reduction > 0)
+						{
+							ab = -alpha_beta<other_color(color_to_move)>(
+							    child_idx, ply + 1, next_depth - reduction, -alpha - 1, -alpha);
+							reduced_search_failed_low = ab <= alpha;
+						}
+					}
+				}
+				++move_number;
+
+				if (reduced_search_failed_low)
+				{
+					// Keep the reduced search's result.
+				}
+				else if (found_pv)
 				{
 					// Do a zero-window search.
 					ab = -alpha_beta<other_color(color_to_move), quiescing>(
@@ -179,12 +586,27 @@ namespace chess
 					    child_idx, ply + !quiescing, next_depth, -beta, -alpha);
 				}
 
-				if (!searching) return 0;
+				if (!*thread_searching) return 0;
 
 				eval = std::max(eval, ab);
 				if (eval >= beta)
 				{
 					if constexpr (!quiescing)
+					{
+						++beta_cutoffs;
+						first_move_beta_cutoffs += (move_number == 1);
+
+						if (batch == stage::quiets)
+						{
+							++quiet_beta_cutoffs;
+							first_quiet_beta_cutoffs += (child_idx == begin_idx);
+						}
+
+						if (is_quiet(board, boards[child_idx]))
+							ordering->update(color_to_move, boards[child_idx].get_move(), previous, ply, depth);
+					}
+
+					if ((!quiescing || config::quiescence_tt) && !excluded_move)
 						tt.store(key, depth, tt_eval_type::beta, beta, ply, boards[child_idx].get_move());
 					return beta;
 				}
@@ -197,22 +619,21 @@ namespace chess
 					if constexpr (!quiescing) update_pv(ply, boards[child_idx]);
 				}
 
-				swap_best_to_front<color_to_move>(child_idx + 1, end_idx);
-			}
-
-			if (generated_moves == gen_moves::captures && (!quiescing || board.in_check()))
-			{
-				end_idx = generate_child_boards<color_to_move, gen_moves::noncaptures>(idx);
-				generated_moves = gen_moves::all;
-			}
-			else
-			{
-				break;
+				// Pick the next move of this batch. The TT move and killers are already in order.
+				if (child_idx + 1 == end_idx)
+					break;
+				else if (batch == stage::quiets)
+					swap_best_quiet_to_front<color_to_move>(previous, child_idx + 1, end_idx);
+				else if (batch == stage::captures)
+					swap_best_capture_to_front<color_to_move>(idx, child_idx + 1, bad_captures_idx, end_idx);
 			}
 		}
 
 		if (!found_moves)
 		{
+			// Without the excluded move, there are no moves to search, so the excluded move is singular.
+			if (excluded_move) return alpha;
+
 			// The position is either terminal (checkmate/stalemate), quiescent, or both.
 			// During quiescence search, we generate all moves if the side to move is in check.
 			// This means we can detect checkmates during quiescence search, but not stalemates.
@@ -229,7 +650,8 @@ namespace chess
 		}
 
 		// If no move was an improvement, tt_move stays as whatever we previously read from the TT.
-		if constexpr (!quiescing) tt.store(key, depth, node_eval_type, eval, ply, tt_move);
+		if ((!quiescing || config::quiescence_tt) && !excluded_move)
+			tt.store(key, depth, node_eval_type, eval, ply, tt_move);
 
 		return eval;
 	}
@@ -1,23 +1,199 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <type_traits>
 
 #include "movegen.hpp"
+#include "see.hpp"
 #include "transposition_table.hpp"
 #include "util/util.hpp"
 
 namespace chess
 {
+	constexpr size_t history_size = max_ply * 4;
+	using pv_table = std::array<std::array<move, max_ply>, max_ply>;
+
 	extern size_t root_ply;
-	extern std::array<tt_key, max_ply * 4> history;
 	extern std::atomic_bool searching;
 	extern util::timepoint scheduled_turn_end;
-	extern size_t nodes;
+	// This thread stops searching once its node count reaches this. Only the main search thread sets it, to enforce a
+	// go command's node limit.
+	extern thread_local constinit size_t iteration_node_limit;
+
+	// Per-thread search state. These point to the main thread's state, except on Lazy SMP helper threads,
+	// which each own their own repetition history and PV tables.
+	extern thread_local constinit tt_key* history;
+	extern thread_local constinit std::array<move, max_ply>* pv_moves;
+	extern thread_local constinit size_t* pv_lengths;
+	extern thread_local constinit size_t nodes;
+	extern thread_local constinit size_t quiescence_nodes;
+	extern thread_local constinit size_t seldepth; // The deepest ply reached by the main search, before quiescence.
+
+	// Search state for each ply of the current path.
+	struct search_stack_entry
+	{
+		move made_move{};       // The move that led to this ply's node, or no move after a null move.
+		move excluded_move{};   // Skipped by a singular extension's search of the other moves.
+		int16_t extensions = 0; // Plies of extensions on the path from the root to this ply.
+	};
+	extern thread_local constinit std::array<search_stack_entry, max_ply + 1> search_stack;
+
+	// Margins for pruning near the leaves, each indexed by depth - 1. Like eval::weights, these are available at
+	// compile time, except in tuning builds, where tune.cpp adjusts them.
+	constexpr size_t max_pruning_depth = 6;
+	constexpr size_t rfp_margins_start = 0;
+	constexpr size_t futility_margins_start = rfp_margins_start + max_pruning_depth;
+	constexpr size_t razoring_margins_start = futility_margins_start + max_pruning_depth;
+	constexpr size_t pruning_margins_size = razoring_margins_start + max_pruning_depth;
+
+	static_assert(config::rfp_max_depth <= max_pruning_depth && config::futility_max_depth <= max_pruning_depth &&
+	              config::razoring_max_depth <= max_pruning_depth);
+
+	// clang-format off
+	constexpr std::array<int16_t, pruning_margins_size> default_pruning_margins = {
+	     80,  160,  240,  320,  400,  480, // reverse futility pruning
+	    125,  225,  325,  425,  525,  625, // futility pruning
+	    300,  450,  600,  750,  900, 1050, // razoring
+	};
+	// clang-format on
+#if !tuning
+	constexpr auto pruning_margins = default_pruning_margins;
+#else
+	// In tuning builds, the margins are mutable, unavailable at compile time, and defined in tune.cpp.
+	extern std::array<int16_t, pruning_margins_size> pruning_margins;
+#endif
+
+	inline constexpr_if_not_tuning eval_t pruning_margin(const size_t margins_start, const depth_t depth)
+	{
+		return pruning_margins[margins_start + depth - 1];
+	}
+
+	// The moves that led to a node: the opponent's last move, then our own move before it. Either is null after a
+	// null move, or before the root.
+	using previous_moves = std::array<move, 2>;
+
+	// Quiet moves that caused beta cutoffs, used to order quiet moves.
+	struct move_ordering
+	{
+		static constexpr int32_t max_history = 16'384;
+		// Enough to rank a countermove above any quiet move's history and continuation history.
+		static constexpr int32_t countermove_score = 3 * max_history;
+
+		// Indexed by the previous move's piece and end square, then by this move's piece and end square.
+		using continuation_table = std::array<
+		    std::array<std::array<std::array<int16_t, 64>, n_of_piece_types>, 64>, n_of_piece_types>;
+
+		std::array<std::array<move, 2>, max_ply> killers{};
+		std::array<std::array<std::array<int16_t, 64>, 64>, 2> history{}; // Indexed by color, start, and end square.
+		// The last quiet reply to cause a cutoff, indexed by color, and the previous move's piece and end square.
+		std::array<std::array<std::array<move, 64>, n_of_piece_types>, 2> countermoves{};
+		// Indexed by how many plies ago the previous move was made (less one), then by color.
+		std::array<std::array<continuation_table, 2>, 2> continuation_history{};
+
+		// Reward a quiet move that caused a cutoff. The bonus shrinks as the score approaches max_history.
+		void update(
+		    const color color, const move move, const previous_moves& previous, const size_t ply, const int32_t depth)
+		{
+			if (killers[ply][0] != move)
+			{
+				killers[ply][1] = killers[ply][0];
+				killers[ply][0] = move;
+			}
+
+			const int32_t bonus = std::min(depth * depth, max_history / 4);
+			add_bonus(history[color][move.get_start_index()][move.get_end_index()], bonus);
+
+			if (config::countermoves && previous[0])
+				countermoves[color][previous[0].get_moved_piece()][previous[0].get_end_index()] = move;
+
+			if constexpr (config::continuation_history)
+				for (size_t i = 0; i < previous.size(); ++i)
+					if (previous[i]) add_bonus(continuation_score(i, color, previous[i], move), bonus);
+		}
+
+		// Rank a quiet move by its countermove, history, and continuation history. Killers are searched before the
+		// other quiet moves are generated.
+		int32_t score(const color color, const move move, const previous_moves& previous) const
+		{
+			int32_t score = history[color][move.get_start_index()][move.get_end_index()];
+
+			if (config::countermoves && previous[0] &&
+			    countermoves[color][previous[0].get_moved_piece()][previous[0].get_end_index()] == move)
+				score += countermove_score;
+
+			// Continuation history is sparser than history, so it's noisier, and counts for half as much.
+			if constexpr (config::continuation_history)
+				for (size_t i = 0; i < previous.size(); ++i)
+					if (previous[i]) score += continuation_score(i, color, previous[i], move) / 2;
+
+			return score;
+		}
+
+		// Between searches, forget killers, and let older history count for less.
+		void age()
+		{
+			killers = {};
+			halve(history);
+			if constexpr (config::continuation_history) halve(continuation_history);
+		}
+
+	private:
+		static void add_bonus(int16_t& score, const int32_t bonus)
+		{
+			score += int16_t(bonus - score * bonus / max_history);
+		}
+
+		int16_t& continuation_score(const size_t plies_ago, const color color, const move previous, const move move)
+		{
+			return continuation_history[plies_ago][color][previous.get_moved_piece()][previous.get_end_index()]
+			                           [move.get_moved_piece()][move.get_end_index()];
+		}
+		int16_t continuation_score(
+		    const size_t plies_ago, const color color, const move previous, const move move) const
+		{
+			return continuation_history[plies_ago][color][previous.get_moved_piece()][previous.get_end_index()]
+			                           [move.get_moved_piece()][move.get_end_index()];
+		}
+
+		static void halve(auto& scores)
+		{
+			if constexpr (std::is_same_v<std::remove_cvref_t<decltype(scores)>, int16_t>)
+				scores /= 2;
+			else
+				for (auto& inner : scores)
+					halve(inner);
+		}
+	};
+	extern thread_local constinit move_ordering* ordering;
 
-	extern transposition_table tt;
+	// The root's moves stay in the order left by the last iteration of iterative deepening: its best move first, then
+	// the others by how many nodes they took, most first. A move that took more nodes was harder to refute.
+	struct root_move_ordering
+	{
+		std::array<size_t, max_n_of_moves> nodes{}; // Nodes searched under each root move, in the order of the boards.
+		bool ordered = false;                       // Cleared when the root's child boards are regenerated.
 
-	extern std::array<std::array<move, max_ply>, max_ply> pv_moves;
-	extern std::array<size_t, max_ply> pv_lengths;
+		void reset()
+		{
+			nodes = {};
+			ordered = false;
+		}
+	};
+	extern thread_local constinit root_move_ordering* root_ordering;
+
+	// Count how often a beta cutoff comes from the first move searched, as a measure of move ordering.
+	extern thread_local constinit size_t beta_cutoffs;
+	extern thread_local constinit size_t first_move_beta_cutoffs;
+	// The same, for cutoffs by quiet moves ordered by history, among the quiet moves left after the killers.
+	extern thread_local constinit size_t quiet_beta_cutoffs;
+	extern thread_local constinit size_t first_quiet_beta_cutoffs;
+
+	// The flag polled by this thread's search. The main thread polls `searching`. Helpers poll their own flag,
+	// so that the main thread can stop them without stopping itself.
+	extern thread_local constinit std::atomic_bool* thread_searching;
+	// If set, this thread's node count is published here every 1024 nodes, for other threads to read.
+	extern thread_local constinit std::atomic<size_t>* published_nodes;
 
 	void update_pv(const size_t ply, const board& board);
 
@@ -34,34 +210,70 @@ namespace chess
 	}
 
 	template <color color_to_move>
-	inline_toggle static void swap_best_to_front(const size_t begin_idx, const size_t end_idx)
+	inline_toggle static void swap_best_quiet_to_front(
+	    const previous_moves& previous, const size_t begin_idx, const size_t end_idx)
 	{
 		size_t best_index = begin_idx;
-		eval_t best_eval = boards[begin_idx].get_eval();
+		int32_t best_score = ordering->score(color_to_move, boards[begin_idx].get_move(), previous);
 
 		for (size_t idx = begin_idx + 1; idx < end_idx; ++idx)
 		{
-			const board& board = boards[idx];
+			const int32_t score = ordering->score(color_to_move, boards[idx].get_move(), previous);
+			if (score > best_score)
+			{
+				best_index = idx;
+				best_score = score;
+			}
+		}
 
-			if constexpr (color_to_move == white)
+		std::swap(boards[begin_idx], boards[best_index]);
+	}
+
+	// Rank a capture: most valuable victim first, then least valuable attacker.
+	inline int32_t capture_score(const bitboards& bitboards, const move move)
+	{
+		if (move.is_promotion())
+			return (captured_value(bitboards, move) + eval::see_values[move.get_moved_piece()]) * 8 - pawn;
+
+		return captured_value(bitboards, move) * 8 - move.get_moved_piece();
+	}
+
+	// Swap the best capture to the front. Captures that lose material by static exchange evaluation are moved behind
+	// bad_captures_idx as they are found, and are only ranked once no other captures are left.
+	template <color color_to_move>
+	inline_toggle static void swap_best_capture_to_front(
+	    const size_t parent_idx, const size_t begin_idx, size_t& bad_captures_idx, const size_t end_idx)
+	{
+		const bitboards& bitboards = boards[parent_idx].get_bitboards();
+
+		while (1)
+		{
+			const bool only_bad_captures_left = begin_idx >= bad_captures_idx;
+			const size_t rank_end_idx = only_bad_captures_left ? end_idx : bad_captures_idx;
+
+			size_t best_index = begin_idx;
+			int32_t best_score = capture_score(bitboards, boards[begin_idx].get_move());
+
+			for (size_t idx = begin_idx + 1; idx < rank_end_idx; ++idx)
 			{
-				if (board.get_eval() > best_eval)
+				const int32_t score = capture_score(bitboards, boards[idx].get_move());
+				if (score > best_score)
 				{
 					best_index = idx;
-					best_eval = board.get_eval();
+					best_score = score;
 				}
 			}
-			else
+
+			// Only evaluate the exchange for the capture we're about to search.
+			if (only_bad_captures_left || !loses_exchange<color_to_move>(bitboards, boards[best_index].get_move()))
 			{
-				if (board.get_eval() < best_eval)
-				{
-					best_index = idx;
-					best_eval = board.get_eval();
-				}
+				std::swap(boards[begin_idx], boards[best_index]);
+				return;
 			}
-		}
 
-		std::swap(boards[begin_idx], boards[best_index]);
+			--bad_captures_idx;
+			std::swap(boards[best_index], boards[bad_captures_idx]);
+		}
 	}
 
 	template <color color_to_move, bool quiescing = false>
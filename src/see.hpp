@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+
+#include "bitboard.hpp"
+#include "defines.hpp"
+#include "evaluation.hpp"
+#include "move.hpp"
+
+namespace chess
+{
+	// Return the type of the piece on a square, or empty.
+	inline piece piece_at(const bitboards& bitboards, const size_t idx)
+	{
+		const bitboard square = 1ull << idx;
+		for (piece piece = pawn; piece <= king; ++piece)
+			if ((&bitboards.pawns)[piece] & square) return piece;
+		return empty;
+	}
+
+	// Return the pieces of both colors that attack a square, given the squares that are still occupied.
+	inline bitboard attackers_to(const bitboards& bitboards, const size_t target_idx, const bitboard occupied)
+	{
+		const bitboard target = 1ull << target_idx;
+		const bitboard white_pawn_attackers =
+		    (pawn_capture_lower_file & (target << 9)) | (pawn_capture_higher_file & (target << 7));
+		const bitboard black_pawn_attackers =
+		    (pawn_capture_lower_file & (target >> 7)) | (pawn_capture_higher_file & (target >> 9));
+
+		const bitboard attackers =
+		    (bitboards.pawns & ((bitboards.white & white_pawn_attackers) | (bitboards.black & black_pawn_attackers))) |
+		    (bitboards.knights & knight_attack_masks[target_idx]) | (bitboards.kings & king_attack_masks[target_idx]) |
+		    ((bitboards.bishops | bitboards.queens) & get_slider_moves<bishop>(occupied, target_idx)) |
+		    ((bitboards.rooks | bitboards.queens) & get_slider_moves<rook>(occupied, target_idx));
+
+		return attackers & occupied;
+	}
+
+	// Return the material captured by a move, counting en passant captures as pawns.
+	inline int32_t captured_value(const bitboards& bitboards, const move move)
+	{
+		const piece victim = piece_at(bitboards, move.get_end_index());
+		if (victim != empty) return eval::see_values[victim];
+
+		const bool pawn_changes_file = (bitboards.pawns & (1ull << move.get_start_index())) &&
+		                               move.get_start_index() % 8 != move.get_end_index() % 8;
+		return pawn_changes_file ? eval::see_values[pawn] : 0;
+	}
+
+	// Statically evaluate the exchange that a move starts on its end square, from the moving side's perspective.
+	// Each side recaptures with its least valuable attacker, and may stop whenever continuing would lose material.
+	// Sliders behind the pieces that have been traded join in as the exchange goes on.
+	template <color moving_color>
+	int32_t static_exchange_eval(const bitboards& bitboards, const move move)
+	{
+		const size_t target_idx = move.get_end_index();
+
+		std::array<int32_t, 32> gains{};
+		gains[0] = captured_value(bitboards, move);
+
+		piece piece_on_target = move.get_moved_piece();
+		bitboard occupied = bitboards.occupied() ^ (1ull << move.get_start_index());
+		bitboard attackers = attackers_to(bitboards, target_idx, occupied);
+		color side = other_color(moving_color);
+
+		size_t depth = 0;
+		while (depth + 1 < gains.size())
+		{
+			const bitboard side_pieces = (side == white) ? bitboards.white : bitboards.black;
+			const bitboard side_attackers = attackers & side_pieces;
+			if (!side_attackers) break;
+
+			piece attacker = pawn;
+			while (!(side_attackers & (&bitboards.pawns)[attacker]))
+				++attacker;
+
+			// The king can only recapture if the square is no longer defended.
+			if (attacker == king && (attackers & ~side_pieces)) break;
+
+			++depth;
+			gains[depth] = eval::see_values[piece_on_target] - gains[depth - 1];
+
+			// Stop once neither side can come out ahead by continuing.
+			if (std::max(-gains[depth - 1], gains[depth]) < 0) break;
+
+			occupied ^= get_next_bit(side_attackers & (&bitboards.pawns)[attacker]);
+			attackers = attackers_to(bitboards, target_idx, occupied);
+			piece_on_target = attacker;
+			side = other_color(side);
+		}
+
+		// Each side chooses between recapturing and stopping.
+		for (; depth > 0; --depth)
+			gains[depth - 1] = -std::max(-gains[depth - 1], gains[depth]);
+
+		return gains[0];
+	}
+
+	// Return true if a move loses material by static exchange evaluation. Promotions are never counted as losing, and
+	// capturing a piece worth at least as much as the capturing piece can't lose, so neither needs an evaluation.
+	template <color moving_color>
+	bool loses_exchange(const bitboards& bitboards, const move move)
+	{
+		if (move.is_promotion()) return false;
+
+		if (eval::see_values[move.get_moved_piece()] <= captured_value(bitboards, move)) return false;
+
+		return static_exchange_eval<moving_color>(bitboards, move) < 0;
+	}
+}
@@ -0,0 +1,136 @@
+
+#include <format>
+#include <iostream>
+#include <thread>
+
+#include "transposition_table.hpp"
+#include "util/util.hpp"
+
+namespace chess
+{
+	// Derive an entry's contents from its key, so that any hit can be checked against the key that was probed.
+	static tt_data expected_data(const tt_key key)
+	{
+		const uint64_t bits = key.value();
+		tt_data data;
+		data.eval_depth = (bits >> 8) % 64;
+		data.eval_type = tt_eval_type::exact;
+		data.eval = eval_t((bits >> 16) % 2'000) - 1'000;
+		data.best_move = std::bit_cast<move>(uint16_t((bits >> 32) | 1));
+		return data;
+	}
+
+	bool transposition_table::map_file()
+	{
+		const size_t size = sizeof(tt_file_header) + n_buckets * sizeof(tt_bucket);
+		void* base = util::map_file(file_path, size, file_read_only);
+		if (base == nullptr)
+		{
+			util::log(std::format("Couldn't map hash file {}, using memory instead.", file_path));
+			return false;
+		}
+
+		file_header = static_cast<tt_file_header*>(base);
+		table = std::unique_ptr<tt_bucket[], table_deleter>(
+		    reinterpret_cast<tt_bucket*>(file_header + 1), {base, size, true});
+
+		const tt_file_header expected{.n_buckets = n_buckets};
+		if (file_header->magic == expected.magic && file_header->version == expected.version &&
+		    file_header->keys_fingerprint == expected.keys_fingerprint && file_header->n_buckets == expected.n_buckets)
+		{
+			// The loaded entries can only be emptied by Clear Hash. ucinewgame just ages them.
+			generation = file_header->generation;
+			dirty = true;
+			util::log(std::format("Loaded hash file {}.", file_path));
+		}
+		else if (file_read_only)
+		{
+			// An existing file we can't use, and can't overwrite. Clearing the private mapping would only copy every
+			// page of it, so use memory instead.
+			table.reset();
+			file_header = nullptr;
+			util::log(std::format("Hash file {} doesn't match this table, using memory instead.", file_path));
+			return false;
+		}
+		else
+		{
+			// A new file, or one we can't use. Start from an empty table. A new file is already zeroed.
+			if (file_header->magic != std::array<char, 8>{}) std::memset(base, 0, size);
+			*file_header = expected;
+			file_header->generation = generation;
+			dirty = false;
+			util::log(std::format("Initialized hash file {}.", file_path));
+		}
+
+		return true;
+	}
+
+	size_t stress_test(const size_t n_threads, const size_t duration_ms)
+	{
+		// Use a small table of our own, so that the test's entries never reach the search's table or a hash file.
+		transposition_table table;
+		table.resize(1);
+		table.allocate();
+		table.new_search();
+
+		// Confine a small set of keys to the first handful of buckets so that threads constantly collide.
+		constexpr uint64_t n_buckets = 4;
+		const uint64_t max_key = std::numeric_limits<uint64_t>::max() / table.bucket_count() * n_buckets;
+
+		// Entries only verify the low 16 bits of their keys, so make those unique. Any mismatched hit is then a torn
+		// entry rather than a legitimate collision.
+		std::array<tt_key, 256> keys;
+		std::mt19937_64 key_rng{0};
+		for (size_t i = 0; i < keys.size(); ++i)
+			keys[i] = ((key_rng() % max_key) & ~0xffffull) | i;
+
+		std::atomic<size_t> total_probes = 0;
+		std::atomic<size_t> total_hits = 0;
+		std::atomic<size_t> corrupted = 0;
+		const util::timepoint end_time = util::time_in_ms() + duration_ms;
+
+		auto hammer = [&](const size_t thread_idx)
+		{
+			std::mt19937_64 rng{thread_idx};
+			size_t probes = 0;
+			size_t hits = 0;
+
+			while (util::time_in_ms() < end_time)
+			{
+				for (size_t i = 0; i < 1'024; ++i)
+				{
+					const tt_key key = keys[rng() % keys.size()];
+					const tt_data data = expected_data(key);
+
+					if (i % 2 == 0)
+					{
+						table.store(key, data.eval_depth, data.eval_type, data.eval, 0, data.best_move);
+						continue;
+					}
+
+					eval_t eval{};
+					move best_move{};
+					++probes;
+					if (!table.probe(eval, best_move, key, 0, -eval::mate, eval::mate, 0)) continue;
+
+					++hits;
+					if (eval != data.eval || best_move != data.best_move) ++corrupted;
+				}
+			}
+
+			total_probes += probes;
+			total_hits += hits;
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < n_threads; ++i)
+			threads.emplace_back(hammer, i);
+		for (auto& thread : threads)
+			thread.join();
+
+		std::cout << std::format("{} threads, {} probes, {} hits, {} corrupted hits.\n", n_threads,
+		    total_probes.load(), total_hits.load(), corrupted.load());
+
+		return corrupted;
+	}
+}
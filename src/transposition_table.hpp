@@ -1,18 +1,28 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <limits>
 #include <memory>
+#include <new>
 #include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "config.hpp"
 #include "defines.hpp"
 #include "evaluation.hpp"
 #include "move.hpp"
+#include "util/intrinsics.hpp"
+#include "util/util.hpp"
 
 namespace chess
 {
-	static_assert(config::tt_size_in_mb / 1024 <= 16); // sanity check, size <= 16 GB
-
 	using tt_key = ::util::strong_alias<uint64_t, struct tt_key_tag>;
 
 	enum class tt_eval_type : uint8_t
@@ -22,29 +32,79 @@ namespace chess
 		exact
 	};
 
-	class tt_entry
+	// A TT entry's data, as read from or written to the table.
+	struct tt_data
 	{
-	private:
-		static constexpr depth_t invalid_depth = std::numeric_limits<depth_t>::min();
-
-	public:
-		tt_key key{};
-		depth_t eval_depth{invalid_depth};
+		depth_t eval_depth{};
 		tt_eval_type eval_type{};
+		uint8_t generation{}; // The search that stored this entry. Empty entries are generation 0.
 		eval_t eval{};
 		move best_move{};
-
-		bool is_valid() const { return eval_depth != invalid_depth; }
 	};
 
-	namespace detail
+	// Entries are read and written by every search thread without locks. Each entry is a single 64-bit word, so a
+	// read never sees half of one write and half of another. The word holds the low 16 bits of the key, which the
+	// bucket index doesn't already imply, followed by the depth, the eval type and generation, the eval, and the move.
+	class tt_entry
 	{
-		constexpr size_t tt_size_in_bytes = (config::tt_size_in_mb * 1024 * 1024);
-		constexpr size_t tt_size_in_entries = tt_size_in_bytes / sizeof(tt_entry);
+	public:
+		static constexpr uint8_t max_generation = (1 << 6) - 1;
+		static constexpr int max_depth = std::numeric_limits<uint8_t>::max();
+		static_assert(max_ply - 1 <= max_depth, "A search's depth must fit in an entry.");
+
+		bool load(tt_data& data, const tt_key key) const
+		{
+			const uint64_t bits = word.load(std::memory_order_relaxed);
+			if (uint16_t(bits) != uint16_t(key.value())) return false;
+
+			data = unpack(bits);
+			return data.generation != 0;
+		}
+
+		void store(const tt_key key, const tt_data& data)
+		{
+			word.store(pack(key, data), std::memory_order_relaxed);
+		}
 
-		static_assert(std::popcount(tt_size_in_entries) == 1);
-		constexpr uint64_t key_mask = tt_size_in_entries - 1;
+		// Read the entry's data without verifying its key.
+		tt_data peek() const { return unpack(word.load(std::memory_order_relaxed)); }
+		bool is_valid() const { return peek().generation != 0; }
 
+	private:
+		static uint64_t pack(const tt_key key, const tt_data& data)
+		{
+			// Clamp the depth, so that an out-of-range depth can't wrap around to a shallow or very deep one.
+			const uint8_t depth = uint8_t(std::clamp(int(data.eval_depth.value()), 0, max_depth));
+			return uint64_t(uint16_t(key.value())) | uint64_t(depth) << 16 |
+			       uint64_t(data.eval_type) << 24 | uint64_t(data.generation) << 26 |
+			       uint64_t(uint16_t(data.eval.value())) << 32 | uint64_t(std::bit_cast<uint16_t>(data.best_move)) << 48;
+		}
+
+		static tt_data unpack(const uint64_t bits)
+		{
+			tt_data data;
+			data.eval_depth = uint8_t(bits >> 16);
+			data.eval_type = tt_eval_type((bits >> 24) & 0b11);
+			data.generation = uint8_t(bits >> 26) & max_generation;
+			data.eval = int16_t(bits >> 32);
+			data.best_move = std::bit_cast<move>(uint16_t(bits >> 48));
+			return data;
+		}
+
+		std::atomic<uint64_t> word{};
+	};
+	static_assert(sizeof(tt_entry) == 8);
+
+	// Entries are grouped into cache-line-sized buckets. A position can be stored in any entry of its bucket.
+	struct alignas(64) tt_bucket
+	{
+		static constexpr size_t n_entries = 8;
+		std::array<tt_entry, n_entries> entries;
+	};
+	static_assert(sizeof(tt_bucket) == 64);
+
+	namespace detail
+	{
 		struct tt_keys_t
 		{
 			std::array<std::array<tt_key, 64>, 12> piece_square_keys;
@@ -77,6 +137,16 @@ namespace chess
 
 			return keys;
 		}();
+
+		// Identifies the keys above, so that a table saved to disk is only reused with the same keys.
+		static const uint64_t tt_keys_fingerprint = []()
+		{
+			uint64_t fingerprint = 0;
+			const auto* key = reinterpret_cast<const tt_key*>(&tt_keys);
+			for (size_t i = 0; i < sizeof(tt_keys) / sizeof(tt_key); ++i)
+				fingerprint = std::rotl(fingerprint, 1) ^ key[i].value();
+			return fingerprint;
+		}();
 	}
 
 	template <color color, piece piece>
@@ -96,50 +166,196 @@ namespace chess
 	inline tt_key b_castle_ks_key() { return detail::tt_keys.b_castle_ks; }
 	inline tt_key b_castle_qs_key() { return detail::tt_keys.b_castle_qs; }
 
+	// The start of a hash file. The buckets follow it.
+	struct alignas(64) tt_file_header
+	{
+		// Increment this whenever the layout of the file or of its entries changes.
+		static constexpr uint32_t current_version = 1;
+
+		std::array<char, 8> magic{'T', 'I', 'K', 'T', 'A', 'A', 'L', 'K'};
+		uint32_t version = current_version;
+		uint64_t keys_fingerprint = detail::tt_keys_fingerprint;
+		uint64_t n_buckets = 0;
+		uint8_t generation = 1;
+	};
+	static_assert(sizeof(tt_file_header) == sizeof(tt_bucket));
+
 	class transposition_table
 	{
 	private:
-		std::vector<tt_entry> table;
+		// Frees the table, whether it was allocated or mapped from a file.
+		struct table_deleter
+		{
+			void* base;
+			size_t size;
+			bool file_backed;
+			void operator()(tt_bucket*) const
+			{
+				if (file_backed)
+					util::unmap_file(base, size);
+				else
+					util::large_free(base, size);
+			}
+		};
+
+		std::unique_ptr<tt_bucket[], table_deleter> table;
+		size_t n_buckets = 0;
+		size_t size_in_mb = config::tt_default_size_in_mb;
+
+		// If a hash file is set, the table is mapped from it, so that it persists between runs.
+		std::string file_path;
+		bool file_read_only = false;
+		tt_file_header* file_header = nullptr;
+
+		// Incremented for each search, so that entries from earlier searches can be replaced first.
+		uint8_t generation = 1;
+
+		// Set once a search may have written to the table, so that clearing a table that is still empty is free.
+		bool dirty = false;
 
 	public:
-		size_t occupied_entries = 0;
-		size_t insertions = 0;
-		size_t updates = 0;
+		// Statistics are counted per search thread.
+		static inline thread_local constinit size_t insertions = 0;
+		static inline thread_local constinit size_t updates = 0;
 
-		size_t hit = 0;
-		size_t miss = 0;
+		static inline thread_local constinit size_t hit = 0;
+		static inline thread_local constinit size_t miss = 0;
 
-		transposition_table() : table{detail::tt_size_in_entries, tt_entry{}} {}
+		// The table is not allocated until allocate() is called, so that startup is fast,
+		// and so that the size can be set first.
+		transposition_table() {}
 
-		template <bool terminal = false>
-		inline_toggle_member void store(const tt_key key, const depth_t eval_depth, const tt_eval_type eval_type,
-		    eval_t eval, const size_t ply, const move best_move)
+		// Set the size of the table. The table is freed, and reallocated by the next call to allocate().
+		void resize(const size_t new_size_in_mb)
+		{
+			if (new_size_in_mb == size_in_mb) return;
+
+			size_in_mb = new_size_in_mb;
+			release();
+		}
+
+		// Back the table with this file, or with memory if the path is empty. The table is freed, and reopened by the
+		// next call to allocate(). If read_only is set, the file is loaded but never written to.
+		void set_file(const std::string& path, const bool read_only)
 		{
-			tt_entry& entry = get_entry(key);
+			if (path == file_path && read_only == file_read_only) return;
+
+			file_path = path;
+			file_read_only = read_only;
+			release();
+		}
 
-			if (!entry.is_valid()) ++occupied_entries;
+		// Allocate the table, if it isn't already. The memory comes from the OS already zeroed, and an all-zero
+		// entry is empty, so the entries aren't constructed here. Pages are only touched as the search fills them.
+		void allocate()
+		{
+			if (table) return;
 
-			if (key != entry.key)
-				++insertions;
-			else
-				++updates;
+			n_buckets = size_in_mb * 1024 * 1024 / sizeof(tt_bucket);
+			if (!file_path.empty() && map_file()) return;
 
-			// if (key != entry.key || eval_type == eval_type::exact)
+			// If the OS can't give us a table this large, halve it until it can.
+			void* base = nullptr;
+			while (base == nullptr)
 			{
-				if constexpr (!terminal)
+				n_buckets = size_in_mb * 1024 * 1024 / sizeof(tt_bucket);
+				try
+				{
+					base = util::large_alloc(n_buckets * sizeof(tt_bucket));
+				}
+				catch (const std::bad_alloc&)
 				{
-					if (eval >= eval::mate_threshold)
-						eval += ply;
-					else if (eval <= -eval::mate_threshold)
-						eval -= ply;
+					if (size_in_mb == 1) throw;
+					util::log(std::format(
+					    "Couldn't allocate a {} MB hash table, trying {} MB.", size_in_mb, size_in_mb / 2));
+					size_in_mb /= 2;
 				}
+			}
+
+			const size_t size = n_buckets * sizeof(tt_bucket);
+			table = std::unique_ptr<tt_bucket[], table_deleter>(static_cast<tt_bucket*>(base), {base, size, false});
+			dirty = false;
+		}
+
+		// Empty the table, splitting the work across threads. Does nothing if the table hasn't been used. A read-only
+		// hash file is never cleared, since that would copy every page of it into private memory. Its entries are
+		// aged out instead.
+		void clear(const size_t n_threads)
+		{
+			if (!dirty) return;
+
+			if (file_header && file_read_only)
+			{
+				next_generation();
+				return;
+			}
+
+			const size_t buckets_per_thread = (n_buckets + n_threads - 1) / n_threads;
+
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < n_threads; ++i)
+			{
+				const size_t begin = std::min(i * buckets_per_thread, n_buckets);
+				const size_t end = std::min(begin + buckets_per_thread, n_buckets);
+				threads.emplace_back([this, begin, end]()
+				    { std::memset(static_cast<void*>(&table[begin]), 0, (end - begin) * sizeof(tt_bucket)); });
+			}
+			for (auto& thread : threads)
+				thread.join();
+
+			dirty = false;
+		}
+
+		// Prepare for a new game. A hash file keeps its entries, so that they persist between games and runs, but
+		// starts a new generation so that they are replaced first. Any other table is cleared.
+		void new_game(const size_t n_threads)
+		{
+			if (file_header)
+				next_generation();
+			else
+				clear(n_threads);
+		}
+
+		size_t bucket_count() const { return n_buckets; }
+
+		// Start loading the bucket for this key into the cache, so that it's ready when the key is probed.
+		// Before the table is allocated, this prefetches a null address, which is harmless.
+		void prefetch(const tt_key key) const { ::util::prefetch(table.get() + ::util::mulhi(key, n_buckets)); }
+
+		// Start a new search. Generations cycle through 1-63; 0 marks empty entries.
+		void new_search()
+		{
+			next_generation();
+			dirty = true;
+		}
 
-				entry.key = key;
-				entry.eval_depth = eval_depth;
-				entry.eval_type = eval_type;
-				entry.eval = eval;
-				entry.best_move = best_move;
+		template <bool terminal = false>
+		inline_toggle_member void store(const tt_key key, const depth_t eval_depth, const tt_eval_type eval_type,
+		    eval_t eval, const size_t ply, const move best_move)
+		{
+			tt_data existing{};
+			tt_entry& entry = select_entry(get_bucket(key), key, existing);
+
+			move stored_move = best_move;
+			if (existing.generation != 0)
+			{
+				// Don't let a shallower bound, such as one from quiescence, replace a deeper entry from this search.
+				if (eval_type != tt_eval_type::exact && eval_depth < existing.eval_depth &&
+				    existing.generation == generation)
+					return;
+
+				if (!stored_move) stored_move = existing.best_move;
+			}
+
+			if constexpr (!terminal)
+			{
+				if (eval >= eval::mate_threshold)
+					eval += ply;
+				else if (eval <= -eval::mate_threshold)
+					eval -= ply;
 			}
+
+			entry.store(key, tt_data{eval_depth, eval_type, generation, eval, stored_move});
 		}
 
 		inline_toggle_member void store(
@@ -151,9 +367,9 @@ namespace chess
 		inline_toggle_member bool probe(eval_t& eval, move& best_move, const tt_key key, const depth_t eval_depth,
 		    const eval_t alpha, const eval_t beta, const size_t ply)
 		{
-			const tt_entry& entry = get_entry(key);
+			tt_data entry;
 
-			if (entry.key != key)
+			if (!find_entry(entry, key))
 			{
 				++miss;
 				return false; // no hit
@@ -209,8 +425,99 @@ namespace chess
 			return false;
 		}
 
+		// Read the entry for this key without counting a hit or a miss. Mate evals are adjusted to this ply.
+		bool peek(tt_data& data, const tt_key key, const size_t ply) const
+		{
+			if (!find_entry(data, key)) return false;
+
+			if (data.eval >= eval::mate_threshold)
+				data.eval -= ply;
+			else if (data.eval <= -eval::mate_threshold)
+				data.eval += ply;
+
+			return true;
+		}
+
+		// Return the occupancy of the table, per mille, estimated from the first thousand entries.
+		size_t hashfull() const
+		{
+			size_t occupied = 0;
+			for (size_t i = 0; i < 1'000 / tt_bucket::n_entries; ++i)
+				for (const tt_entry& entry : table[i].entries)
+					occupied += entry.is_valid();
+			return occupied;
+		}
+
 	private:
-		const tt_entry& get_entry(const tt_key key) const { return table[key & detail::key_mask]; }
-		tt_entry& get_entry(const tt_key key) { return table[key & detail::key_mask]; }
+		void next_generation()
+		{
+			generation = (generation == tt_entry::max_generation) ? 1 : generation + 1;
+			if (file_header) file_header->generation = generation;
+		}
+
+		void release()
+		{
+			table.reset();
+			file_header = nullptr;
+			n_buckets = 0;
+			dirty = false; // There's nothing left to clear.
+		}
+
+		// Map the table from the hash file, keeping its entries if it was saved with the same size, keys, and version.
+		// Returns false if the file couldn't be mapped, or if it is read-only and doesn't match the table.
+		bool map_file();
+
+		// Map the key onto the table using multiply-shift, so that the table can be any size.
+		const tt_bucket& get_bucket(const tt_key key) const { return table[::util::mulhi(key, n_buckets)]; }
+		tt_bucket& get_bucket(const tt_key key) { return table[::util::mulhi(key, n_buckets)]; }
+
+		bool find_entry(tt_data& data, const tt_key key) const
+		{
+			for (const tt_entry& entry : get_bucket(key).entries)
+				if (entry.load(data, key)) return true;
+			return false;
+		}
+
+		// Return the entry to overwrite with this key: the entry that already holds this key if there is one, along
+		// with its data, otherwise the least valuable entry in the bucket.
+		tt_entry& select_entry(tt_bucket& bucket, const tt_key key, tt_data& existing)
+		{
+			tt_entry* replacement = &bucket.entries[0];
+			int32_t replacement_value = std::numeric_limits<int32_t>::max();
+
+			for (tt_entry& entry : bucket.entries)
+			{
+				if (entry.load(existing, key))
+				{
+					++updates;
+					return entry;
+				}
+
+				const int32_t value = replacement_value_of(entry.peek());
+				if (value < replacement_value)
+				{
+					replacement = &entry;
+					replacement_value = value;
+				}
+			}
+
+			++insertions;
+			return *replacement;
+		}
+
+		// Deeper entries are worth more, and entries lose value with each search since they were stored.
+		int32_t replacement_value_of(const tt_data& data) const
+		{
+			if (data.generation == 0) return std::numeric_limits<int32_t>::min(); // Fill empty entries first.
+
+			const int32_t age = (tt_entry::max_generation + generation - data.generation) % tt_entry::max_generation;
+			return data.eval_depth - age * config::tt_age_weight;
+		}
 	};
+
+	extern transposition_table tt;
+
+	// Hammer a handful of entries of a test table from many threads, and count any hit that returns data written for a
+	// different key. Returns the number of corrupted hits, which should be zero.
+	size_t stress_test(const size_t n_threads, const size_t duration_ms);
 }
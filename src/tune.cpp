@@ -62,6 +62,14 @@ namespace chess
 	// During tuning, instead provide it here.
 	std::array<int16_t, pse_size + pce_size + fpce_size> eval::weights;
 
+	// Likewise for the search's pruning margins, which start at their defaults.
+	std::array<int16_t, pruning_margins_size> pruning_margins = default_pruning_margins;
+
+	// Pruning margins only affect search, so tune them against the error of a shallow search of the first
+	// margin_tuning_positions positions, instead of the static eval.
+	constexpr depth_t margin_tuning_depth = 4;
+	constexpr size_t margin_tuning_positions = 10'000;
+
 	bool load_weights()
 	{
 		std::cout << "Loading weights from " << weights_file << '\n';
@@ -467,6 +475,139 @@ namespace chess
 		return error_sum / set.size();
 	}
 
+	// Get the mean squared error for a shallow search of the first margin_tuning_positions positions.
+	static double evaluate_search()
+	{
+		// Search from a clean TT, so that entries from searches with other margins aren't reused. The table is only
+		// cleared once it's marked as used, which starting a search does.
+		tt.new_search();
+		tt.clear(1);
+
+		// Our own searching flag is never cleared, and the search is never out of time, so it always finishes.
+		std::atomic_bool tuning_searching{true};
+		thread_searching = &tuning_searching;
+		scheduled_turn_end = std::numeric_limits<util::timepoint>::max();
+
+		const size_t n_positions = std::min(extended_positions.size(), margin_tuning_positions);
+		double error_sum = 0.0;
+
+		for (size_t i = 0; i < n_positions; ++i)
+		{
+			const extended_position& ep = extended_positions[i];
+
+			boards[0] = ep.board;
+			boards[0].generate_eval();
+
+			const eval_t eval = (ep.side_to_move == white)
+			                        ? alpha_beta<white>(0, 0, margin_tuning_depth, -eval::mate, eval::mate)
+			                        : -alpha_beta<black>(0, 0, margin_tuning_depth, -eval::mate, eval::mate);
+
+			const double error = ep.result - sigmoid((double)eval);
+			error_sum += (error * error);
+		}
+
+		thread_searching = &searching;
+
+		return error_sum / n_positions;
+	}
+
+	static void print_pruning_margins()
+	{
+		std::stringstream ss;
+		ss << "pruning_margins = {\n";
+
+		for (size_t i = 0; i < pruning_margins_size; ++i)
+		{
+			if (i % max_pruning_depth == 0) ss << '\t' << "  ";
+
+			ss << std::setw(5) << std::right << int(pruning_margins[i]) << ',';
+
+			if (i + 1 == rfp_margins_start + max_pruning_depth)
+				ss << " // reverse futility pruning\n";
+			else if (i + 1 == futility_margins_start + max_pruning_depth)
+				ss << " // futility pruning\n";
+			else if (i + 1 == razoring_margins_start + max_pruning_depth)
+				ss << " // razoring\n";
+		}
+
+		ss << "};";
+
+		util::log(ss.str());
+		std::cout << ss.str() << '\n';
+	}
+
+	static void tune_pruning_margins(const eval_t delta)
+	{
+		{
+			std::stringstream ss;
+			ss << std::format("Tuning pruning margins ({} margins) using delta = +/-{}, against depth {} searches.",
+			    pruning_margins_size, delta, margin_tuning_depth);
+			util::log(ss.str());
+			std::cout << ss.str() << '\n';
+		}
+
+		const auto start = util::time_in_ms();
+		size_t pass = 1;
+
+		const double error_before = evaluate_search();
+		double error_after = error_before;
+		bool improving = true;
+
+		{
+			std::stringstream ss;
+			ss << std::format("Starting error: {:1.9f}", error_before);
+			util::log(ss.str());
+			std::cout << ss.str() << '\n';
+		}
+
+		while (improving)
+		{
+			const auto pass_start = util::time_in_ms();
+			improving = false;
+
+			for (size_t i = 0; i < pruning_margins_size; ++i)
+			{
+				for (const eval_t d : {delta, -delta})
+				{
+					// A margin of zero or less would prune regardless of the eval.
+					if (pruning_margins[i] + d <= 0) continue;
+
+					pruning_margins[i] += d;
+
+					const double new_error = evaluate_search();
+
+					if (new_error < error_after)
+					{
+						std::cout << std::format(
+						    "Improved pruning_margins[{:>2}] from {:>4} to {:>4}. New error: {:1.9f}\n", i,
+						    int(pruning_margins[i] - d), int(pruning_margins[i]), new_error);
+						error_after = new_error;
+						improving = true;
+						break;
+					}
+
+					pruning_margins[i] -= d;
+				}
+			}
+
+			const auto now = util::time_in_ms();
+
+			std::stringstream ss;
+			ss << std::format("Finished pass {} in {} seconds ({} minutes elapsed).", pass++,
+			    (now - pass_start) / 1'000, (now - start) / 60'000);
+			util::log(ss.str());
+			std::cout << ss.str() << '\n';
+			print_pruning_margins();
+		}
+
+		{
+			std::stringstream ss;
+			ss << std::format("Finished tuning. Error: {:1.9f}", error_after);
+			util::log(ss.str());
+			std::cout << ss.str() << '\n';
+		}
+	}
+
 	static void tune_k()
 	{
 		double best_error = evaluate(extended_positions);
@@ -640,6 +781,8 @@ namespace chess
 		std::cout << "\t                   (bishop pair, knight pair, last pawn, etc.)\n";
 		std::cout << "\ttune fpce [delta]  Tune file piece-count evals using the provided delta.\n";
 		std::cout << "\t                   (doubled pawns, rooks paired on a file, etc.)\n";
+		std::cout << "\ttune margins [delta]\n";
+		std::cout << "\t                   Tune search pruning margins using the provided delta.\n";
 	}
 
 	void game::tune(const std::vector<std::string>& args)
@@ -713,6 +856,12 @@ namespace chess
 			load_games();
 			tune_weights("file piece-count evals", fpce_start, fpce_size, delta);
 		}
+		else if (args[1] == "margins")
+		{
+			load_games();
+			tt.allocate();
+			tune_pruning_margins(delta);
+		}
 		else
 		{
 			std::cout << "Tune command unrecognized/invalid.\n";
@@ -16,7 +16,12 @@ namespace chess
 		std::cout << command << std::endl;
 	}
 
-	void game::send_info(const eval_t eval)
+	void game::send_info(const eval_t eval, const tt_eval_type bound, const size_t pv_idx)
+	{
+		send_info(eval, bound, pv_idx, std::span(pv_moves[0].data(), pv_lengths[0]));
+	}
+
+	void game::send_info(const eval_t eval, const tt_eval_type bound, const size_t pv_idx, std::span<const move> pv)
 	{
 		if (pondering) return; // Don't emit info while pondering.
 
@@ -26,6 +31,8 @@ namespace chess
 		ss << "info";
 
 		ss << " depth " << engine_depth + 1;
+		ss << " seldepth " << seldepth; // The main search thread's.
+		if (multi_pv > 1) ss << " multipv " << pv_idx + 1;
 
 		// Print evaluation in the form "score cp 104" or "score mate -3".
 		if (eval >= eval::mate_threshold || eval <= -eval::mate_threshold)
@@ -46,18 +53,25 @@ namespace chess
 			ss << " score cp " << ((color_to_move == white) ? eval : eval * -1);
 		}
 
+		// An aspiration search that failed high or low only found a bound.
+		if (bound == tt_eval_type::beta)
+			ss << " lowerbound";
+		else if (bound == tt_eval_type::alpha)
+			ss << " upperbound";
+
+		const size_t nodes = total_nodes(); // Include any Lazy SMP helpers.
 		ss << " nps " << nodes * 1'000 / std::max(decltype(engine_time)(1), engine_time);
 		ss << " nodes " << nodes;
-		ss << " hashfull " << tt.occupied_entries * 1'000 / detail::tt_size_in_entries; // Occupancy is per mille.
+		ss << " hashfull " << tt.hashfull();
 		ss << " tbhits " << tt.hit;
 		ss << " time " << engine_time;
 
-		if (pv_lengths[0] > 0)
+		if (!pv.empty())
 		{
 			ss << " pv";
-			for (size_t i = 0; i < pv_lengths[0]; ++i)
+			for (const move move : pv)
 			{
-				ss << ' ' << pv_moves[0][i];
+				ss << ' ' << move;
 			}
 		}
 
@@ -74,21 +88,74 @@ namespace chess
 
 	void game::process_setoption_command(std::vector<std::string>& args)
 	{
-		if (args.size() != 5)
+		// setoption name some name [value some_value]
+
+		if (args.size() < 3 || args[1] != "name")
 		{
-			util::log("Unexpected number of tokens in setoption command.");
+			util::log("Unexpected tokens in setoption command.");
 			return;
 		}
 
-		// setoption name some_name value some_value
+		// Option names can contain spaces. Join the tokens up to "value" (if any).
+		const auto value_it = std::find(args.cbegin() + 2, args.cend(), "value");
+		std::string name = args[2];
+		for (auto it = args.cbegin() + 3; it < value_it; ++it)
+			name += ' ' + *it;
+		util::to_lower(name);
 
-		util::to_lower(args[2]);
+		// Values can also contain spaces, such as in file paths.
+		std::string value;
+		if (value_it != args.cend())
+			for (auto it = value_it + 1; it < args.cend(); ++it)
+				value += (value.empty() ? "" : " ") + *it;
 
-		if (args[2] == "ponder")
+		if (name == "ponder")
 		{
-			util::to_lower(args[4]);
-			ponder_enabled = (args[4] == "true");
+			util::to_lower(value);
+			ponder_enabled = (value == "true");
 			util::log(std::format("Ponder {}.", ponder_enabled ? "enabled" : "disabled"));
+			return;
+		}
+
+		// The remaining options can't be changed during a search.
+		searching = false;
+		const std::lock_guard<decltype(game_mutex)> lock(game_mutex);
+		pondering = false;
+
+		if (name == "threads")
+		{
+			const size_t n_threads = std::clamp(atoi(value.c_str()), 1, int(config::max_threads));
+			set_threads(n_threads);
+			util::log(std::format("Using {} search threads.", n_threads));
+		}
+		else if (name == "hash")
+		{
+			const size_t size_in_mb = std::clamp(atoi(value.c_str()), 1, int(config::tt_max_size_in_mb));
+			tt.resize(size_in_mb);
+			util::log(std::format("Hash size set to {} MB.", size_in_mb));
+		}
+		else if (name == "hashfile")
+		{
+			hash_file = (value == "<empty>") ? "" : value;
+			tt.set_file(hash_file, hash_file_read_only);
+			util::log(hash_file.empty() ? "Hash file disabled." : std::format("Hash file set to {}.", hash_file));
+		}
+		else if (name == "hashfilereadonly")
+		{
+			util::to_lower(value);
+			hash_file_read_only = (value == "true");
+			tt.set_file(hash_file, hash_file_read_only);
+			util::log(std::format("Hash file is {}.", hash_file_read_only ? "read-only" : "writable"));
+		}
+		else if (name == "multipv")
+		{
+			multi_pv = std::clamp(atoi(value.c_str()), 1, int(max_n_of_moves));
+			util::log(std::format("Searching {} PVs.", multi_pv));
+		}
+		else if (name == "clear hash")
+		{
+			tt.clear(helpers.size() + 1);
+			util::log("Cleared hash.");
 		}
 		else
 		{
@@ -113,6 +180,7 @@ namespace chess
 		engine_depth = 0;
 		engine_time = 0;
 		pv_lengths[0] = 0;
+		pv_lines.clear();
 		root_ply = 0;
 
 		std::string fen;
@@ -145,6 +213,45 @@ namespace chess
 		}
 	}
 
+	void game::clear_search_limits()
+	{
+		depth_limit = max_ply;
+		node_limit = std::numeric_limits<size_t>::max();
+		mate_limit = 0;
+		searched_nodes = 0;
+		search_single_move = false;
+	}
+
+	void game::restrict_root_moves(const std::vector<std::string>& args, size_t move_idx)
+	{
+		// Move the listed root moves to the front, and search only those. The list ends at the first token that isn't
+		// a root move, such as the next go parameter.
+		const size_t begin_idx = first_child_index(0);
+		const size_t end_idx = begin_idx + n_legal_moves;
+		size_t kept_idx = begin_idx;
+
+		for (; move_idx < args.size(); ++move_idx)
+		{
+			board* const it = std::find_if(boards + kept_idx, boards + end_idx,
+			    [&](const board& board) { return board.get_move().to_string() == args[move_idx]; });
+			if (it == boards + end_idx) break;
+
+			std::swap(*it, boards[kept_idx]);
+			++kept_idx;
+		}
+
+		if (kept_idx == begin_idx)
+		{
+			util::log("No legal moves in searchmoves, searching all moves.");
+			return;
+		}
+
+		n_legal_moves = kept_idx - begin_idx;
+		root_moves_restricted = true;
+		root_ordering->reset();
+		util::log(std::format("Searching {} root moves.", n_legal_moves));
+	}
+
 	void game::process_go_command(const std::vector<std::string>& args)
 	{
 		if (args.size() < 2)
@@ -159,6 +266,12 @@ namespace chess
 		pondering = false;
 		util::log("Processing go command.");
 
+		tt.allocate(); // In case we didn't get an isready command.
+
+		// Forget the last go command's limits and root moves.
+		clear_search_limits();
+		if (root_moves_restricted) generate_child_boards_for_root();
+
 		size_t time_left = 0;
 		size_t time_inc = 0;
 		size_t moves_to_go = 0;
@@ -190,6 +303,27 @@ namespace chess
 					moves_to_go = atoi((arg_it + 1)->c_str());
 					continue;
 				}
+				else if (*arg_it == "depth")
+				{
+					// Stay below max_ply, so that the depth fits in a TT entry.
+					depth_limit = depth_t(std::clamp(atoi((arg_it + 1)->c_str()), 1, int(max_ply) - 1));
+					continue;
+				}
+				else if (*arg_it == "nodes")
+				{
+					node_limit = std::max(std::strtoull((arg_it + 1)->c_str(), nullptr, 10), 1ull);
+					continue;
+				}
+				else if (*arg_it == "mate")
+				{
+					mate_limit = std::max(atoi((arg_it + 1)->c_str()), 1);
+					continue;
+				}
+				else if (*arg_it == "searchmoves")
+				{
+					restrict_root_moves(args, arg_it + 1 - args.cbegin());
+					continue;
+				}
 				else if (*arg_it == "perft" || *arg_it == "divide")
 				{
 					size_t depth = atoi((arg_it + 1)->c_str());
@@ -224,11 +358,18 @@ namespace chess
 			}
 		}
 
+		// Without a clock, a search with a depth, node, or mate limit runs until it reaches the limit.
+		const bool limited = depth_limit < depth_t{max_ply} || node_limit != std::numeric_limits<size_t>::max() ||
+		                     mate_limit > 0;
+
+		// These searches report on the position, so search it even when there is only one move to play.
+		search_single_move = infinite || limited;
+
 		if (exact)
 		{
 			scheduled_turn_end = util::time_in_ms() + time_left;
 		}
-		else if (infinite || pondering)
+		else if (infinite || pondering || (limited && time_left == 0))
 		{
 			scheduled_turn_end = util::time_in_ms() + 1'000'000'000; // ~11 days.
 		}
@@ -276,6 +417,11 @@ namespace chess
 		// Reset the engine's depth to make sure we get PV updates.
 		engine_depth = 0;
 
+		tt.new_search();
+		ordering->age();
+		for (auto& helper : helpers)
+			helper->ordering.age();
+
 		// Awaken the search thread.
 		searching = true;
 		searching.notify_one();
@@ -301,12 +447,29 @@ namespace chess
 				send_command("id name Tiktaalik");
 				send_command("id author Jim Viebke");
 				send_command("option name Ponder type check default false");
+				send_command(std::format("option name Threads type spin default 1 min 1 max {}", config::max_threads));
+				send_command(std::format("option name Hash type spin default {} min 1 max {}",
+				    config::tt_default_size_in_mb, config::tt_max_size_in_mb));
+				send_command(std::format("option name MultiPV type spin default 1 min 1 max {}", max_n_of_moves));
+				send_command("option name Clear Hash type button");
+				send_command("option name HashFile type string default <empty>");
+				send_command("option name HashFileReadOnly type check default false");
 				send_command("uciok");
 			}
 			else if (args[0] == "isready")
 			{
+				// Allocate the hash table now, after any Hash option has been set, and before the first search.
+				tt.allocate();
 				send_command("readyok");
 			}
+			else if (args[0] == "ucinewgame")
+			{
+				searching = false;
+				const std::lock_guard<decltype(game_mutex)> lock(game_mutex);
+				pondering = false;
+
+				tt.new_game(helpers.size() + 1);
+			}
 			else if (args[0] == "setoption") // setoption name some_name [value some_value]
 			{
 				process_setoption_command(args);
@@ -329,6 +492,16 @@ namespace chess
 			{
 				break;
 			}
+			else if (args[0] == "ttstress") // ttstress [threads] [ms]
+			{
+				searching = false;
+				const std::lock_guard<decltype(game_mutex)> lock(game_mutex);
+				pondering = false;
+
+				const size_t n_threads = (args.size() > 1) ? atoi(args[1].c_str()) : std::thread::hardware_concurrency();
+				const size_t duration_ms = (args.size() > 2) ? atoi(args[2].c_str()) : 5'000;
+				stress_test(std::max(n_threads, 2uz), duration_ms);
+			}
 			else if (args[0] == "tune")
 			{
 #if tuning
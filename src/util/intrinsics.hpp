@@ -15,5 +15,16 @@ namespace util
 
 	inline uint64_t pext(const uint64_t src, const uint64_t mask) { return _pext_u64(src, mask); }
 
+	// Return the high 64 bits of the 128-bit product.
+	inline uint64_t mulhi(const uint64_t a, const uint64_t b)
+	{
+		unsigned long long hi;
+		_mulx_u64(a, b, &hi);
+		return hi;
+	}
+
+	// Hint that the cache line at this address will be read soon.
+	inline void prefetch(const void* address) { _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0); }
+
 	inline constexpr uint64_t popcount(const uint64_t src) { return _mm_popcnt_u64(src); }
 }
@@ -1,8 +1,22 @@
 
 #include <chrono>
+#include <cstdint>
 #include <format>
 #include <fstream>
+#include <new>
 
+#if defined _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "../config.hpp"
 #include "util.hpp"
 
 namespace chess::util
@@ -51,4 +65,103 @@ namespace chess::util
 			c = std::tolower(c);
 		}
 	}
+
+	void* large_alloc(const size_t size)
+	{
+#if defined _WIN32
+		// Committed pages are zeroed by the OS the first time they are touched.
+		void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (ptr == nullptr) throw std::bad_alloc{};
+		return ptr;
+#else
+		// Anonymous mappings are zero pages until they are first written. Over-allocate, then unmap the ends,
+		// so that the block is aligned to 2 MB and can be backed by huge pages.
+		constexpr size_t alignment = 2 * 1024 * 1024;
+		const size_t mapped_size = size + alignment;
+
+		void* mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping == MAP_FAILED) throw std::bad_alloc{};
+
+		const uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+		const uintptr_t aligned_start = (start + alignment - 1) / alignment * alignment;
+		const size_t tail_size = mapped_size - (aligned_start - start) - size;
+		if (aligned_start != start) munmap(mapping, aligned_start - start);
+		if (tail_size != 0) munmap(reinterpret_cast<void*>(aligned_start + size), tail_size);
+
+		void* ptr = reinterpret_cast<void*>(aligned_start);
+
+	#if defined __linux__
+		if constexpr (config::use_huge_pages)
+		{
+			// This is only advice. If transparent huge pages are disabled or unavailable, we keep 4 KB pages.
+			if (madvise(ptr, size, MADV_HUGEPAGE) != 0) log("madvise(MADV_HUGEPAGE) failed, using 4 KB pages.");
+		}
+	#endif
+
+		return ptr;
+#endif
+	}
+
+	void large_free(void* ptr, const size_t size)
+	{
+#if defined _WIN32
+		(void)size;
+		VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+		munmap(ptr, size);
+#endif
+	}
+
+	void* map_file(const std::string& path, const size_t size, const bool read_only)
+	{
+#if defined _WIN32
+		const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | (read_only ? 0 : GENERIC_WRITE),
+		    FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, read_only ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+		    nullptr);
+		if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+		LARGE_INTEGER file_size{};
+		if (!GetFileSizeEx(file, &file_size) || (read_only && size_t(file_size.QuadPart) != size))
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		// A writable mapping extends the file to the mapping's size. A copy-on-write mapping never writes to the file.
+		const HANDLE mapping = CreateFileMappingA(file, nullptr, read_only ? PAGE_WRITECOPY : PAGE_READWRITE,
+		    DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr) return nullptr;
+
+		void* ptr = MapViewOfFile(mapping, read_only ? FILE_MAP_COPY : FILE_MAP_WRITE, 0, 0, size);
+		CloseHandle(mapping);
+		return ptr;
+#else
+		const int fd = open(path.c_str(), read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+		if (fd < 0) return nullptr;
+
+		// Size the file to fit, unless we can't change it. The new space reads as zero.
+		struct stat file_stat{};
+		if (fstat(fd, &file_stat) != 0 || (size_t(file_stat.st_size) != size && (read_only || ftruncate(fd, size) != 0)))
+		{
+			close(fd);
+			return nullptr;
+		}
+
+		// A private mapping is copy-on-write: this process can write to it, but the file is never changed.
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, read_only ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+		close(fd);
+		return (ptr == MAP_FAILED) ? nullptr : ptr;
+#endif
+	}
+
+	void unmap_file(void* ptr, const size_t size)
+	{
+#if defined _WIN32
+		(void)size;
+		UnmapViewOfFile(ptr);
+#else
+		munmap(ptr, size);
+#endif
+	}
 }
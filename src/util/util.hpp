@@ -11,4 +11,17 @@ namespace chess::util
 
 	std::vector<std::string> tokenize(const std::string& str);
 	void to_lower(std::string& str);
+
+	// Allocate a large, zeroed block of memory directly from the OS. Pages aren't touched until they are first used.
+	// Outside Windows, the block is aligned to 2 MB, and on Linux, if config::use_huge_pages is set, the kernel is asked
+	// to back it with transparent huge pages. On Windows, it is only aligned to the 64 KB allocation granularity.
+	// Free with large_free(), passing the same size.
+	void* large_alloc(const size_t size);
+	void large_free(void* ptr, const size_t size);
+
+	// Map a file into memory, creating it or resizing it to this size if needed. If read_only is set, the file must
+	// already be this size, and is never modified; writes to the mapping stay private to this process.
+	// Returns nullptr on failure. Unmap with unmap_file(), passing the same size.
+	void* map_file(const std::string& path, const size_t size, const bool read_only);
+	void unmap_file(void* ptr, const size_t size);
 }